@@ -0,0 +1,293 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <getopt.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "imdb.h"
+#include "pathfinder.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+
+static void printUsage(const char *executable) {
+  cerr << "Usage: " << executable << " [--samples <n>] [--cold-samples <n>] [--threads <n>] [--seed <n>]"
+       << " [--load <policy>]... [<data-directory>]" << endl;
+  cerr << "Load policies:";
+  for (int i = 0; i < imdb::kNumLoadPolicies; i++) cerr << " " << imdb::getLoadPolicyName((imdb::loadPolicy) i);
+  cerr << endl;
+}
+
+/**
+ * The queries are drawn before anything is timed, so that every run (cold
+ * or warm) asks exactly the same questions in the same order.
+ */
+struct workload {
+  vector<string> players;
+  vector<film> films;
+  vector<pair<string, string>> pairs;
+};
+
+static workload drawWorkload(const imdb& db, size_t numSamples, unsigned seed) {
+  mt19937 rng(seed);
+  workload w;
+  int numActors = db.getNumActors(), numMovies = db.getNumMovies();
+  for (size_t i = 0; i < numSamples && numActors > 0; i++) w.players.push_back(db.getActorName(rng() % numActors));
+  for (size_t i = 0; i < numSamples && numMovies > 0; i++) w.films.push_back(db.getMovie(rng() % numMovies));
+  for (size_t i = 0; i < numSamples && numActors > 1; i++) {
+    int first = rng() % numActors, second = rng() % (numActors - 1);
+    if (second >= first) second++;
+    w.pairs.push_back(make_pair(db.getActorName(first), db.getActorName(second)));
+  }
+  return w;
+}
+
+/**
+ * Latencies (in microseconds) of one operation over one run, along with the
+ * page faults taken over the course of the whole run (which, for cold runs,
+ * includes opening each fresh imdb).
+ */
+struct measurement {
+  vector<double> latencies;
+  long minorFaults;
+  long majorFaults;
+};
+
+static double getPercentile(const vector<double>& sorted, double fraction) {
+  if (sorted.empty()) return 0;
+  size_t rank = ceil(fraction * sorted.size());
+  return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+}
+
+static void printMeasurement(const string& run, const string& operation, measurement m) {
+  sort(m.latencies.begin(), m.latencies.end());
+  cout << left << setw(12) << run << setw(12) << operation << right << setw(9) << m.latencies.size()
+       << fixed << setprecision(1)
+       << setw(11) << getPercentile(m.latencies, 0.5) << setw(11) << getPercentile(m.latencies, 0.99)
+       << setw(11) << getPercentile(m.latencies, 0.999)
+       << setw(11) << (m.latencies.empty() ? 0 : m.latencies.back())
+       << setw(10) << m.minorFaults << setw(10) << m.majorFaults << endl;
+}
+
+/**
+ * Asks the kernel to drop every file in the directory from the page cache.
+ * Only pages nobody has mapped are dropped, which is why cold runs open a
+ * fresh imdb (and close it again) around every single query.
+ */
+static void evictPageCache(const string& directory) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == NULL) return;
+  while (struct dirent *entry = readdir(dir)) {
+    int fd = open((directory + "/" + entry->d_name).c_str(), O_RDONLY);
+    if (fd == -1) continue;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+  closedir(dir);
+}
+
+/**
+ * Times query(db, i) for every sample i.  A warm run reuses the one imdb it's
+ * handed, which has already been prefaulted.  A cold run evicts the database
+ * from the page cache and opens a fresh imdb before each (timed) query.
+ */
+template <typename Query>
+static measurement timeQueries(const imdb *warm, const string& directory, size_t numSamples, Query query) {
+  measurement m;
+  struct rusage before, after;
+  getrusage(RUSAGE_SELF, &before);
+  for (size_t i = 0; i < numSamples; i++) {
+    if (warm != NULL) {
+      auto start = chrono::steady_clock::now();
+      query(*warm, i);
+      chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+      m.latencies.push_back(elapsed.count());
+      continue;
+    }
+
+    evictPageCache(directory);
+    imdb db(directory);
+    auto start = chrono::steady_clock::now();
+    query(db, i);
+    chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+    m.latencies.push_back(elapsed.count());
+  }
+  getrusage(RUSAGE_SELF, &after);
+  m.minorFaults = after.ru_minflt - before.ru_minflt;
+  m.majorFaults = after.ru_majflt - before.ru_majflt;
+  return m;
+}
+
+static void runQueries(const string& run, const imdb *warm, const string& directory, const workload& w,
+                       size_t numSamples, size_t numThreads) {
+  vector<film> credits;
+  vector<string> cast;
+  printMeasurement(run, "getCredits", timeQueries(warm, directory, min(numSamples, w.players.size()),
+                                                  [&](const imdb& db, size_t i) {
+    credits.clear();
+    db.getCredits(w.players[i], credits);
+  }));
+  printMeasurement(run, "getCast", timeQueries(warm, directory, min(numSamples, w.films.size()),
+                                               [&](const imdb& db, size_t i) {
+    cast.clear();
+    db.getCast(w.films[i], cast);
+  }));
+  printMeasurement(run, "findPath", timeQueries(warm, directory, min(numSamples, w.pairs.size()),
+                                                [&](const imdb& db, size_t i) {
+    findPath(db, w.pairs[i].first, w.pairs[i].second, numThreads, kAllYears);
+  }));
+}
+
+/**
+ * Loads a fresh imdb under each of the specified policies, with the database
+ * evicted from the page cache beforehand, and times the first --cold-samples
+ * queries of each kind against it.  (A background load carries on while
+ * they run.)  What each load cost is tabulated afterwards.
+ */
+static void compareLoadPolicies(const vector<imdb::loadPolicy>& policies, const string& directory,
+                                const workload& w, size_t numSamples, size_t numThreads) {
+  vector<imdb::loadStatistics> loads;
+  for (imdb::loadPolicy policy: policies) {
+    evictPageCache(directory);
+    imdb db(directory, policy);
+    runQueries(imdb::getLoadPolicyName(policy), &db, directory, w, numSamples, numThreads);
+    db.awaitBackgroundLoad();
+    loads.push_back(db.getLoadStatistics());
+  }
+
+  cout << endl << left << setw(12) << "policy" << right << setw(11) << "load (ms)" << setw(10) << "minflt"
+       << setw(10) << "majflt" << setw(13) << "mapped (MB)" << setw(14) << "applied (MB)"
+       << setw(11) << "bg (ms)" << setw(10) << "bg minflt" << setw(10) << "bg majflt" << endl;
+  for (const imdb::loadStatistics& load: loads) {
+    cout << left << setw(12) << imdb::getLoadPolicyName(load.policy) << right << fixed << setprecision(1)
+         << setw(11) << load.loadSeconds * 1000 << setw(10) << load.minorFaults << setw(10) << load.majorFaults
+         << setw(13) << load.mappedBytes / 1048576.0 << setw(14) << load.appliedBytes / 1048576.0
+         << setw(11) << load.backgroundSeconds * 1000
+         << setw(10) << load.backgroundMinorFaults << setw(10) << load.backgroundMajorFaults << endl;
+  }
+}
+
+/**
+ * Reads the resident set size out of /proc, in kilobytes.
+ */
+static long getResidentSetSize() {
+  ifstream statm("/proc/self/statm");
+  long size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Program: imdb-bench
+ * -------------------
+ * Times getCredits and getCast on actors and films drawn at random from the
+ * offset tables, and findPath on random pairs of actors, and reports the
+ * median, 99th, and 99.9th percentile latencies of each along with the page
+ * faults taken and the resident set size.  Every operation is measured cold
+ * (the database evicted from the page cache and a fresh imdb opened before
+ * each query, for --cold-samples queries) and then warm (--samples queries
+ * against one prefaulted imdb).  The sidecars in use are listed up front,
+ * so that runs against different index variants can be compared.  Finally,
+ * each load policy (or just those named with --load) is tried from a cold
+ * page cache, reporting the first queries' latencies and faults under it
+ * along with the time and faults the load itself took.
+ */
+int main(int argc, char *argv[]) {
+  struct option options[] = {
+    {"samples", required_argument, NULL, 's'},
+    {"cold-samples", required_argument, NULL, 'c'},
+    {"threads", required_argument, NULL, 't'},
+    {"seed", required_argument, NULL, 'S'},
+    {"load", required_argument, NULL, 'l'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t numSamples = 10000, numColdSamples = 100, numThreads = 1;
+  unsigned seed = 1;
+  vector<imdb::loadPolicy> policies;
+  while (true) {
+    int ch = getopt_long(argc, argv, "s:c:t:S:l:", options, NULL);
+    if (ch == -1) break;
+    switch (ch) {
+    case 's':
+    case 'c':
+    case 't':
+      if (atoi(optarg) <= 0) {
+        printUsage(argv[0]);
+        return kWrongArgumentCount;
+      }
+      (ch == 's' ? numSamples : ch == 'c' ? numColdSamples : numThreads) = atoi(optarg);
+      break;
+    case 'S':
+      seed = strtoul(optarg, NULL, 10);
+      break;
+    case 'l': {
+      imdb::loadPolicy policy;
+      if (!imdb::parseLoadPolicy(optarg, policy)) {
+        printUsage(argv[0]);
+        return kWrongArgumentCount;
+      }
+      policies.push_back(policy);
+      break;
+    }
+    default:
+      printUsage(argv[0]);
+      return kWrongArgumentCount;
+    }
+  }
+
+  if (argc - optind > 1) {
+    printUsage(argv[0]);
+    return kWrongArgumentCount;
+  }
+
+  string directory = optind < argc ? argv[optind] : kIMDBDataDirectory;
+  if (policies.empty()) {
+    for (int i = 0; i < imdb::kNumLoadPolicies; i++) policies.push_back((imdb::loadPolicy) i);
+  }
+
+  workload w;
+  {
+    imdb db(directory);
+    if (!db.good()) {
+      cerr << "Failed to properly initialize the imdb database in " << directory << "." << endl;
+      return kDatabaseNotFound;
+    }
+    cout << db.getNumActors() << " actors and " << db.getNumMovies() << " films in " << directory << " ("
+         << (db.isCompressed() ? "compressed" : "uncompressed")
+         << ", graph " << (db.hasGraph() ? "yes" : "no")
+         << ", lookup indexes " << (db.hasLookupIndexes() ? "yes" : "no")
+         << ", landmarks " << (db.hasLandmarks() ? db.getNumLandmarks() : 0)
+         << ", delta credits " << db.getNumDeltaCredits() << ")." << endl << endl;
+    w = drawWorkload(db, max(numSamples, numColdSamples), seed);
+  }
+
+  cout << left << setw(12) << "run" << setw(12) << "operation" << right << setw(9) << "samples"
+       << setw(11) << "p50 (us)" << setw(11) << "p99 (us)" << setw(11) << "p999 (us)" << setw(11) << "max (us)"
+       << setw(10) << "minflt" << setw(10) << "majflt" << endl;
+  runQueries("cold", NULL, directory, w, numColdSamples, numThreads);
+
+  {
+    imdb db(directory);
+    db.prefault();
+    runQueries("warm", &db, directory, w, numSamples, numThreads);
+  }
+
+  compareLoadPolicies(policies, directory, w, numColdSamples, numThreads);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  cout << endl << "Resident set size: " << getResidentSetSize() / 1024 << " MB now, "
+       << usage.ru_maxrss / 1024 << " MB at peak." << endl;
+  return 0;
+}
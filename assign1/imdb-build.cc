@@ -0,0 +1,186 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "imdb.h"
+#include "imdb-builder.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kCreditsNotFound = 2;
+static const int kMalformedCredits = 3;
+static const int kDatabaseNotWritten = 4;
+static const int kVerificationFailed = 5;
+
+static void printUsage(const char *executable) {
+  cerr << "Usage: " << executable << " [--jobs <n>] <credits-file> [<data-directory>]" << endl;
+}
+
+/**
+ * A year is stored as a single signed byte holding year - 1900.
+ */
+static const int kMinYear = 1900 + SCHAR_MIN;
+static const int kMaxYear = 1900 + SCHAR_MAX;
+
+/**
+ * The credits file is mapped privately and writably, and every tab and
+ * newline is overwritten with a '\0' as it's parsed, so that names can be
+ * handed around as C strings pointing straight into the mapping.  The byte
+ * after the mapping (see mapCredits) is a '\0' already, and ends the last
+ * line should it have no newline.  Reports the first malformed line of the
+ * chunk, or NULL if there wasn't one.
+ */
+static char *parseCredits(char *begin, char *end, vector<credit>& credits) {
+  while (begin < end) {
+    char *newline = (char *) memchr(begin, '\n', end - begin);
+    char *lineEnd = newline == NULL ? end : newline;
+    char *next = newline == NULL ? end : newline + 1;
+    if (lineEnd > begin && lineEnd[-1] == '\r') lineEnd--;
+    if (lineEnd == begin) {
+      begin = next;
+      continue;
+    }
+    char *firstTab = (char *) memchr(begin, '\t', lineEnd - begin);
+    char *secondTab = firstTab == NULL ? NULL : (char *) memchr(firstTab + 1, '\t', lineEnd - firstTab - 1);
+    if (secondTab == NULL || firstTab == begin || secondTab == firstTab + 1) return begin;
+    char year[8];
+    size_t yearLength = lineEnd - secondTab - 1;
+    if (yearLength == 0 || yearLength >= sizeof(year)) return begin;
+    memcpy(year, secondTab + 1, yearLength);
+    year[yearLength] = '\0';
+    char *yearEnd;
+    long value = strtol(year, &yearEnd, 10);
+    if (*yearEnd != '\0' || value < kMinYear || value > kMaxYear) return begin;
+    *firstTab = *secondTab = '\0';
+    if (lineEnd != end) *lineEnd = '\0';
+    credit c = { begin, firstTab + 1, (int) value };
+    credits.push_back(c);
+    begin = next;
+  }
+  return NULL;
+}
+
+/**
+ * Maps the textSize bytes of the credits file over the front of an
+ * anonymous mapping one byte longer, so that the text is always followed
+ * by a '\0', even when it fills its last page.  Returns NULL if the file
+ * can't be mapped.
+ */
+static char *mapCredits(int fd, size_t textSize) {
+  void *text = mmap(NULL, textSize + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (text == MAP_FAILED) return NULL;
+  if (textSize > 0 && mmap(text, textSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(text, textSize + 1);
+    return NULL;
+  }
+  return (char *) text;
+}
+
+/**
+ * Program: imdb-build
+ * -------------------
+ * Compiles a file of tab-separated (actor, title, year) credits, one per
+ * line, into the actordata and moviedata files that imdb maps, writing
+ * them to the standard data directory unless another directory is named.
+ * Parsing, sorting, and writing are all split across --jobs threads, and
+ * the result is read back through imdb and checked against the credits
+ * before the program reports success.  Any graphdata, indexes, landmarks,
+ * hub tables, or delta in the directory are removed, and the derived files
+ * need rebuilding.
+ */
+int main(int argc, char *argv[]) {
+  struct option options[] = {
+    {"jobs", required_argument, NULL, 'j'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t numJobs = max(thread::hardware_concurrency(), 1u);
+  while (true) {
+    int ch = getopt_long(argc, argv, "j:", options, NULL);
+    if (ch == -1) break;
+    if (ch != 'j' || atoi(optarg) <= 0) {
+      printUsage(argv[0]);
+      return kWrongArgumentCount;
+    }
+    numJobs = atoi(optarg);
+  }
+
+  if (argc - optind < 1 || argc - optind > 2) {
+    printUsage(argv[0]);
+    return kWrongArgumentCount;
+  }
+
+  const char *creditsFileName = argv[optind];
+  string directory = argc - optind == 2 ? argv[optind + 1] : kIMDBDataDirectory;
+  int fd = open(creditsFileName, O_RDONLY);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    cerr << "Failed to open " << creditsFileName << "." << endl;
+    return kCreditsNotFound;
+  }
+  size_t textSize = st.st_size;
+  char *text = mapCredits(fd, textSize);
+  close(fd);
+  if (text == NULL) {
+    cerr << "Failed to map " << creditsFileName << "." << endl;
+    return kCreditsNotFound;
+  }
+
+  auto start = chrono::steady_clock::now();
+  numJobs = max<size_t>(min<size_t>(numJobs, textSize / 4096), 1);
+  vector<char *> chunks(numJobs + 1, text + textSize);
+  chunks[0] = text;
+  for (size_t j = 1; j < numJobs; j++) {
+    char *split = max(text + textSize * j / numJobs, chunks[j - 1]);
+    char *newline = (char *) memchr(split, '\n', text + textSize - split);
+    chunks[j] = newline == NULL ? text + textSize : newline + 1;
+  }
+  vector<vector<credit>> parsed(numJobs);
+  vector<char *> malformed(numJobs);
+  runInParallel(numJobs, numJobs, [&](size_t, size_t begin, size_t end) {
+    for (size_t j = begin; j < end; j++) malformed[j] = parseCredits(chunks[j], chunks[j + 1], parsed[j]);
+  });
+  for (char *line: malformed) {
+    if (line == NULL) continue;
+    cerr << "Malformed credit (expected <actor>\\t<title>\\t<year>, with the year between "
+         << kMinYear << " and " << kMaxYear << "): " << string(line, strcspn(line, "\r\n")) << endl;
+    return kMalformedCredits;
+  }
+
+  vector<credit> allCredits;
+  for (vector<credit>& chunk: parsed) {
+    allCredits.insert(allCredits.end(), chunk.begin(), chunk.end());
+    vector<credit>().swap(chunk);
+  }
+
+  databaseSummary summary;
+  string problem;
+  switch (buildDatabase(allCredits, directory, numJobs, summary, problem)) {
+  case kBuildSucceeded:
+    break;
+  case kBuildTooLarge:
+    cerr << problem << endl;
+    return kMalformedCredits;
+  case kBuildNotWritten:
+    cerr << problem << endl;
+    return kDatabaseNotWritten;
+  case kBuildNotVerified:
+    cerr << problem << endl;
+    return kVerificationFailed;
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  cout << "Built and verified " << summary.numActors << " actors, " << summary.numMovies << " movies, and "
+       << summary.numCredits << " credits into " << directory << " in " << elapsed.count() << " seconds." << endl;
+  return 0;
+}
@@ -0,0 +1,287 @@
+#include "imdb-builder.h"
+#include <fstream>
+#include <atomic>
+#include <utility>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "imdb.h"
+using namespace std;
+
+struct movieKey {
+  const char *title;
+  int year;
+};
+
+/**
+ * Orders the same way imdb searches: by strcmp, and then by year.
+ */
+static bool operator<(const movieKey& lhs, const movieKey& rhs) {
+  int cmp = strcmp(lhs.title, rhs.title);
+  return cmp < 0 || (cmp == 0 && lhs.year < rhs.year);
+}
+
+static bool isLessName(const char *lhs, const char *rhs) {
+  return strcmp(lhs, rhs) < 0;
+}
+
+/**
+ * Sorts numJobs slices of the vector concurrently, and then merges
+ * neighbouring runs pairwise, concurrently, until a single run remains.
+ */
+template <typename T, typename Compare>
+static void parallelSort(vector<T>& v, size_t numJobs, Compare isLess) {
+  numJobs = max<size_t>(min(numJobs, v.size()), 1);
+  vector<size_t> bounds;
+  for (size_t j = 0; j <= numJobs; j++) bounds.push_back(v.size() * j / numJobs);
+  runInParallel(numJobs, numJobs, [&](size_t, size_t begin, size_t end) {
+    for (size_t j = begin; j < end; j++) sort(v.begin() + bounds[j], v.begin() + bounds[j + 1], isLess);
+  });
+  while (bounds.size() > 2) {
+    vector<size_t> merged;
+    for (size_t j = 0; j + 1 < bounds.size(); j += 2) merged.push_back(bounds[j]);
+    merged.push_back(v.size());
+    size_t numMerges = (bounds.size() - 1) / 2;
+    runInParallel(numMerges, numMerges, [&](size_t, size_t begin, size_t end) {
+      for (size_t m = begin; m < end; m++) {
+        inplace_merge(v.begin() + bounds[2 * m], v.begin() + bounds[2 * m + 1], v.begin() + bounds[2 * m + 2], isLess);
+      }
+    });
+    bounds = merged;
+  }
+}
+
+static size_t getActorRecordSize(const char *player, size_t numMovies) {
+  size_t size = strlen(player) + 1;
+  if (size % 2 != 0) size++;
+  size += sizeof(short);
+  if (size % 4 != 0) size += 2;
+  return size + numMovies * sizeof(int);
+}
+
+static size_t getMovieRecordSize(const char *title, size_t numActors) {
+  size_t size = strlen(title) + 2;
+  if (size % 2 != 0) size++;
+  size += sizeof(short);
+  if (size % 4 != 0) size += 2;
+  return size + numActors * sizeof(int);
+}
+
+/**
+ * A compressed-sparse-row view of one side of the credits: the ids listed
+ * for record i are entries[rows[i]] through entries[rows[i + 1] - 1].
+ */
+struct adjacency {
+  vector<size_t> rows;
+  vector<int> entries;
+};
+
+/**
+ * Builds the adjacency from (record, listed) pairs that are already sorted
+ * and free of duplicates.
+ */
+static adjacency buildAdjacency(const vector<pair<int, int>>& pairs, size_t numRecords) {
+  adjacency a;
+  a.rows.assign(numRecords + 1, 0);
+  a.entries.reserve(pairs.size());
+  for (const pair<int, int>& p: pairs) {
+    a.rows[p.first + 1]++;
+    a.entries.push_back(p.second);
+  }
+  for (size_t i = 0; i < numRecords; i++) a.rows[i + 1] += a.rows[i];
+  return a;
+}
+
+/**
+ * Lays out one data file exactly as imdb expects to find it: the record
+ * count, the offsets of the records in sorted order, and then the records
+ * themselves, in that same order.  Returns the record offsets, or an empty
+ * vector if the file would be too large for int offsets.
+ */
+template <typename RecordSize>
+static vector<int> layOut(size_t numRecords, RecordSize recordSize, size_t& fileSize) {
+  vector<int> offsets(numRecords);
+  size_t offset = sizeof(int) * (numRecords + 1);
+  for (size_t i = 0; i < numRecords; i++) {
+    if (offset > INT_MAX) return vector<int>();
+    offsets[i] = offset;
+    offset += recordSize(i);
+  }
+  fileSize = offset;
+  return offsets;
+}
+
+/**
+ * Fills in one record per id, numJobs ranges of ids at a time.  writeHeader
+ * writes the record's name (and year) and returns a pointer to where the
+ * count goes; the list of offsets follows on the next 4-byte boundary.
+ */
+template <typename WriteHeader>
+static void fillFile(vector<char>& file, const vector<int>& offsets, const adjacency& lists,
+                     const vector<int>& listedOffsets, size_t numJobs, WriteHeader writeHeader) {
+  *(int *) file.data() = offsets.size();
+  memcpy(file.data() + sizeof(int), offsets.data(), offsets.size() * sizeof(int));
+  runInParallel(numJobs, offsets.size(), [&](size_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      short numListed = lists.rows[i + 1] - lists.rows[i];
+      char *record = file.data() + offsets[i];
+      char *count = writeHeader(record, i);
+      memcpy(count, &numListed, sizeof(short));
+      int *payload = (int *)(record + ((count - record + sizeof(short) + 3) & ~size_t(3)));
+      for (size_t k = lists.rows[i]; k < lists.rows[i + 1]; k++) *payload++ = listedOffsets[lists.entries[k]];
+    }
+  });
+}
+
+static bool writeFile(const string& fileName, const vector<char>& bytes) {
+  const string tempFileName = fileName + ".tmp";
+  ofstream out(tempFileName.c_str(), ios::binary | ios::trunc);
+  out.write(bytes.data(), bytes.size());
+  out.close();
+  if (!out || rename(tempFileName.c_str(), fileName.c_str()) != 0) {
+    unlink(tempFileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Reopens the freshly written database and checks, using the same getCredits
+ * and getCast calls that imdbtest relies on, that every actor and every
+ * movie comes back with exactly the list it was built from.
+ */
+static bool verify(const string& directory, const vector<const char *>& actors, const vector<movieKey>& movies,
+                   const adjacency& credits, const adjacency& casts, size_t numJobs) {
+  imdb db(directory);
+  if (!db.good() || db.getNumActors() != (int) actors.size() || db.getNumMovies() != (int) movies.size()) return false;
+  atomic<bool> failed(false);
+  runInParallel(numJobs, actors.size(), [&](size_t, size_t begin, size_t end) {
+    vector<film> found;
+    for (size_t i = begin; i < end && !failed; i++) {
+      found.clear();
+      if (!db.getCredits(actors[i], found) || found.size() != credits.rows[i + 1] - credits.rows[i]) failed = true;
+      for (size_t k = 0; k < found.size() && !failed; k++) {
+        const movieKey& expected = movies[credits.entries[credits.rows[i] + k]];
+        if (found[k].title != expected.title || found[k].year != expected.year) failed = true;
+      }
+    }
+  });
+  runInParallel(numJobs, movies.size(), [&](size_t, size_t begin, size_t end) {
+    vector<string> found;
+    for (size_t i = begin; i < end && !failed; i++) {
+      film movie = { movies[i].title, movies[i].year };
+      found.clear();
+      if (!db.getCast(movie, found) || found.size() != casts.rows[i + 1] - casts.rows[i]) failed = true;
+      for (size_t k = 0; k < found.size() && !failed; k++) {
+        if (found[k] != actors[casts.entries[casts.rows[i] + k]]) failed = true;
+      }
+    }
+  });
+  return !failed;
+}
+
+/**
+ * Actors and films are sorted and deduplicated to assign them ids, every
+ * credit is translated to a pair of ids, and the pairs, sorted both ways,
+ * give each actor's credits and each film's cast in id order.  The records
+ * are then laid out in id order, so each file is written front to back.
+ */
+buildStatus buildDatabase(vector<credit>& credits, const string& directory, size_t numJobs,
+                          databaseSummary& summary, string& problem) {
+  vector<const char *> actors;
+  vector<movieKey> movies;
+  for (const credit& c: credits) {
+    movieKey key = { c.title, c.year };
+    if (c.player != NULL) actors.push_back(c.player);
+    if (c.title != NULL) movies.push_back(key);
+  }
+  parallelSort(actors, numJobs, isLessName);
+  actors.erase(unique(actors.begin(), actors.end(), [](const char *lhs, const char *rhs) {
+    return strcmp(lhs, rhs) == 0;
+  }), actors.end());
+  parallelSort(movies, numJobs, [](const movieKey& lhs, const movieKey& rhs) { return lhs < rhs; });
+  movies.erase(unique(movies.begin(), movies.end(), [](const movieKey& lhs, const movieKey& rhs) {
+    return !(lhs < rhs) && !(rhs < lhs);
+  }), movies.end());
+
+  vector<pair<int, int>> byActor(credits.size()), byMovie(credits.size());
+  runInParallel(numJobs, credits.size(), [&](size_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      if (credits[i].player == NULL || credits[i].title == NULL) {
+        byActor[i] = byMovie[i] = make_pair(-1, -1);
+        continue;
+      }
+      movieKey key = { credits[i].title, credits[i].year };
+      int actorId = lower_bound(actors.begin(), actors.end(), credits[i].player, isLessName) - actors.begin();
+      int movieId = lower_bound(movies.begin(), movies.end(), key) - movies.begin();
+      byActor[i] = make_pair(actorId, movieId);
+      byMovie[i] = make_pair(movieId, actorId);
+    }
+  });
+  vector<credit>().swap(credits);
+  for (vector<pair<int, int>>* pairs: {&byActor, &byMovie}) {
+    parallelSort(*pairs, numJobs, less<pair<int, int>>());
+    pairs->erase(unique(pairs->begin(), pairs->end()), pairs->end());
+    pairs->erase(pairs->begin(), lower_bound(pairs->begin(), pairs->end(), make_pair(0, 0)));
+  }
+  adjacency actorCredits = buildAdjacency(byActor, actors.size());
+  adjacency casts = buildAdjacency(byMovie, movies.size());
+  vector<pair<int, int>>().swap(byActor);
+  vector<pair<int, int>>().swap(byMovie);
+
+  for (size_t i = 0; i < actors.size(); i++) {
+    if (actorCredits.rows[i + 1] - actorCredits.rows[i] <= SHRT_MAX) continue;
+    problem = string(actors[i]) + " has more than " + to_string(SHRT_MAX) + " credits, which the file format can't record.";
+    return kBuildTooLarge;
+  }
+  for (size_t i = 0; i < movies.size(); i++) {
+    if (casts.rows[i + 1] - casts.rows[i] <= SHRT_MAX) continue;
+    problem = string(movies[i].title) + " (" + to_string(movies[i].year) + ") has more than " +
+      to_string(SHRT_MAX) + " cast members, which the file format can't record.";
+    return kBuildTooLarge;
+  }
+
+  size_t actorFileSize, movieFileSize;
+  vector<int> actorOffsets = layOut(actors.size(), [&](size_t i) {
+    return getActorRecordSize(actors[i], actorCredits.rows[i + 1] - actorCredits.rows[i]);
+  }, actorFileSize);
+  vector<int> movieOffsets = layOut(movies.size(), [&](size_t i) {
+    return getMovieRecordSize(movies[i].title, casts.rows[i + 1] - casts.rows[i]);
+  }, movieFileSize);
+  if (actorOffsets.size() != actors.size() || movieOffsets.size() != movies.size()) {
+    problem = "The credits are too numerous to be addressed by the file format.";
+    return kBuildTooLarge;
+  }
+
+  vector<char> actorFile(actorFileSize, 0), movieFile(movieFileSize, 0);
+  fillFile(actorFile, actorOffsets, actorCredits, movieOffsets, numJobs, [&](char *record, size_t i) {
+    size_t length = strlen(actors[i]) + 1;
+    memcpy(record, actors[i], length);
+    return record + length + length % 2;
+  });
+  fillFile(movieFile, movieOffsets, casts, actorOffsets, numJobs, [&](char *record, size_t i) {
+    size_t length = strlen(movies[i].title) + 1;
+    memcpy(record, movies[i].title, length);
+    record[length++] = movies[i].year - 1900;
+    return record + length + length % 2;
+  });
+
+  if (!imdb::removeSidecars(directory) ||
+      !writeFile(directory + "/actordata", actorFile) || !writeFile(directory + "/moviedata", movieFile) ||
+      !imdb::removeDelta(directory)) {
+    problem = "Failed to write the database to " + directory + ".";
+    return kBuildNotWritten;
+  }
+
+  if (!verify(directory, actors, movies, actorCredits, casts, numJobs)) {
+    problem = "The database written to " + directory + " doesn't match the credits it was built from.";
+    return kBuildNotVerified;
+  }
+
+  summary.numActors = actors.size();
+  summary.numMovies = movies.size();
+  summary.numCredits = actorCredits.entries.size();
+  return kBuildSucceeded;
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+/**
+ * Struct: credit
+ * --------------
+ * One (actor, title, year) credit to be compiled into a database.  The
+ * strings aren't copied, so they need to outlive the call to buildDatabase.
+ * A credit with a NULL title just records an actor who has no credits, and
+ * one with a NULL player a film with no cast.
+ */
+struct credit {
+  const char *player;
+  const char *title;
+  int year;
+};
+
+/**
+ * Struct: databaseSummary
+ * -----------------------
+ * What buildDatabase wrote, once duplicate credits were discarded.
+ */
+struct databaseSummary {
+  size_t numActors;
+  size_t numMovies;
+  size_t numCredits;
+};
+
+enum buildStatus {
+  kBuildSucceeded,
+  kBuildTooLarge,     // a list longer than a short can count, or a file larger than an int can address
+  kBuildNotWritten,
+  kBuildNotVerified
+};
+
+/**
+ * Function: buildDatabase
+ * -----------------------
+ * Compiles the specified credits (which may repeat) into the actordata and
+ * moviedata files that imdb maps, and writes them to the specified directory,
+ * after removing the graphdata, indexes, landmarks, and hub tables derived
+ * from the files being replaced (and, once they're replaced, any delta).
+ * Sorting and writing are split across numJobs threads.  The files are then
+ * read back through imdb and checked, using the same getCredits and getCast
+ * calls that imdbtest relies on, against the credits they were built from.
+ * The credits vector is emptied along the way to free its memory.  Returns
+ * kBuildSucceeded and fills in the summary if all went well, and otherwise
+ * returns what went wrong, with a description in problem.
+ */
+buildStatus buildDatabase(std::vector<credit>& credits, const std::string& directory, size_t numJobs,
+                          databaseSummary& summary, std::string& problem);
+
+/**
+ * Function: runInParallel
+ * -----------------------
+ * Splits [0, n) into (at most) numJobs contiguous ranges and calls
+ * work(job, begin, end) for each of them on its own thread.
+ */
+template <typename Work>
+void runInParallel(size_t numJobs, size_t n, Work work) {
+  numJobs = std::max<size_t>(std::min(numJobs, n), 1);
+  std::vector<std::thread> workers;
+  for (size_t j = 0; j < numJobs; j++) {
+    workers.push_back(std::thread(work, j, n * j / numJobs, n * (j + 1) / numJobs));
+  }
+  for (std::thread& t: workers) t.join();
+}
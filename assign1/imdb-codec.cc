@@ -0,0 +1,265 @@
+#include "imdb-codec.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define IMDB_CODEC_SSSE3 1
+#endif
+using namespace std;
+
+/**
+ * The last list is followed by this many bytes of padding, so that the SSSE3
+ * decoder can always load sixteen bytes at once without running off the end.
+ */
+static const size_t kListPadding = 16;
+
+const int compressedTable::kNamesPerBlock;
+const size_t compressedTable::kDecodeBatch;
+
+static void appendVarint(vector<unsigned char>& bytes, uint32_t value) {
+  while (value >= 0x80) {
+    bytes.push_back((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  bytes.push_back(value);
+}
+
+static uint32_t readVarint(const unsigned char *& bytes) {
+  uint32_t value = 0;
+  for (int shift = 0; ; shift += 7) {
+    unsigned char byte = *bytes++;
+    value |= uint32_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) return value;
+  }
+}
+
+static void appendBytes(vector<unsigned char>& bytes, const void *data, size_t numBytes) {
+  const unsigned char *first = (const unsigned char *) data;
+  bytes.insert(bytes.end(), first, first + numBytes);
+}
+
+/**
+ * A control byte describes four deltas, two bits apiece (lowest bits first),
+ * each holding one less than the number of bytes its delta occupies.  These
+ * tables give, for every possible control byte, the total number of delta
+ * bytes and the pshufb mask that spreads those bytes out into four 32-bit
+ * lanes (0x80 zeroes a byte).
+ */
+struct controlTables {
+  unsigned char lengths[256];
+  unsigned char masks[256][16];
+
+  controlTables() {
+    for (int control = 0; control < 256; control++) {
+      int offset = 0;
+      for (int lane = 0; lane < 4; lane++) {
+        int length = ((control >> (2 * lane)) & 3) + 1;
+        for (int b = 0; b < 4; b++)
+          masks[control][4 * lane + b] = b < length ? offset + b : 0x80;
+        offset += length;
+      }
+      lengths[control] = offset;
+    }
+  }
+};
+
+static const controlTables& getControlTables() {
+  static const controlTables tables;
+  return tables;
+}
+
+/**
+ * Decodes numDeltas deltas (at most four, all described by the one control
+ * byte) one at a time, adding each to the running total in previous.
+ */
+static void decodeGroup(unsigned char control, const unsigned char *& data, size_t numDeltas,
+                        uint32_t& previous, int *ids) {
+  for (size_t lane = 0; lane < numDeltas; lane++) {
+    int length = ((control >> (2 * lane)) & 3) + 1;
+    uint32_t delta = 0;
+    for (int b = 0; b < length; b++) delta |= uint32_t(data[b]) << (8 * b);
+    data += length;
+    previous += delta;
+    ids[lane] = previous;
+  }
+}
+
+#ifdef IMDB_CODEC_SSSE3
+/**
+ * Decodes numGroups full groups of four deltas with one shuffle apiece, and
+ * then turns the deltas into ids with an in-register prefix sum.
+ */
+__attribute__((target("ssse3")))
+static void decodeGroupsSSSE3(const unsigned char *& control, const unsigned char *& data, size_t numGroups,
+                              uint32_t& previous, int *ids) {
+  const controlTables& tables = getControlTables();
+  __m128i running = _mm_set1_epi32(previous);
+  for (size_t g = 0; g < numGroups; g++) {
+    unsigned char c = *control++;
+    __m128i deltas = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data),
+                                      _mm_loadu_si128((const __m128i *) tables.masks[c]));
+    data += tables.lengths[c];
+    deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+    deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+    running = _mm_add_epi32(deltas, running);
+    _mm_storeu_si128((__m128i *)(ids + 4 * g), running);
+    running = _mm_shuffle_epi32(running, 0xff);
+  }
+  previous = _mm_cvtsi128_si32(running);
+}
+
+static bool hasSSSE3() {
+  static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3"));
+  return supported;
+}
+#endif
+
+bool compressedTable::attach(const void *file, size_t fileSize) {
+  const fileHeader *candidate = (const fileHeader *) file;
+  if (file == NULL || fileSize < sizeof(fileHeader) || candidate->magic != kMagic) return false;
+  size_t numRecords = candidate->numRecords;
+  size_t numBlocks = candidate->numBlocks;
+  bool valid = candidate->numRecords >= 0 &&
+    numBlocks == (numRecords + kNamesPerBlock - 1) / kNamesPerBlock &&
+    candidate->blocksOffset + 4 * numBlocks <= candidate->namesOffset &&
+    candidate->namesOffset <= candidate->listOffsetsOffset &&
+    candidate->listOffsetsOffset + 4 * (numRecords + 1) <= candidate->listsOffset &&
+    candidate->listsOffset <= candidate->yearsOffset &&
+    candidate->yearsOffset + (candidate->hasYears ? numRecords : 0) == fileSize;
+  if (!valid) return false;
+  const uint32_t *offsets = (const uint32_t *)((const char *) file + candidate->listOffsetsOffset);
+  if (candidate->listsOffset + offsets[numRecords] + kListPadding > candidate->yearsOffset) return false;
+
+  header = candidate;
+  blockOffsets = (const uint32_t *)((const char *) file + header->blocksOffset);
+  names = (const char *) file + header->namesOffset;
+  listOffsets = offsets;
+  lists = (const unsigned char *) file + header->listsOffset;
+  years = header->hasYears ? (const signed char *) file + header->yearsOffset : NULL;
+  return true;
+}
+
+int compressedTable::size() const {
+  return header->numRecords;
+}
+
+size_t compressedTable::getIndexSize() const {
+  return header->namesOffset;
+}
+
+const char *compressedTable::nextName(const char *entry, string& name) {
+  const unsigned char *bytes = (const unsigned char *) entry;
+  uint32_t shared = readVarint(bytes);
+  name.resize(shared);
+  name.append((const char *) bytes);
+  return (const char *) bytes + (name.size() - shared) + 1;
+}
+
+const char *compressedTable::getName(int id, string& scratch) const {
+  int block = id / kNamesPerBlock;
+  const char *entry = names + blockOffsets[block];
+  scratch = entry;
+  entry += scratch.size() + 1;
+  for (int i = block * kNamesPerBlock; i < id; i++) entry = nextName(entry, scratch);
+  return scratch.c_str();
+}
+
+int compressedTable::getYear(int id) const {
+  return 1900 + years[id];
+}
+
+idCursor compressedTable::getList(int id) const {
+  const unsigned char *list = lists + listOffsets[id];
+  idCursor cursor;
+  cursor.remaining = readVarint(list);
+  cursor.control = list;
+  cursor.data = list + (cursor.remaining + 3) / 4;
+  cursor.previous = 0;
+  return cursor;
+}
+
+/**
+ * Batches hold a multiple of four ids, so every batch but the last consists
+ * of whole groups, and only the last can end partway through a control byte.
+ */
+size_t compressedTable::decodeIds(idCursor& cursor, int *ids) {
+  size_t numIds = min<size_t>(cursor.remaining, kDecodeBatch);
+  size_t numGroups = numIds / 4;
+  size_t group = 0;
+#ifdef IMDB_CODEC_SSSE3
+  if (hasSSSE3()) {
+    decodeGroupsSSSE3(cursor.control, cursor.data, numGroups, cursor.previous, ids);
+    group = numGroups;
+  }
+#endif
+  for (; group < numGroups; group++)
+    decodeGroup(*cursor.control++, cursor.data, 4, cursor.previous, ids + 4 * group);
+  if (numIds % 4 != 0)
+    decodeGroup(*cursor.control++, cursor.data, numIds % 4, cursor.previous, ids + 4 * numGroups);
+  cursor.remaining -= numIds;
+  return numIds;
+}
+
+static void appendList(vector<unsigned char>& bytes, vector<int> ids) {
+  sort(ids.begin(), ids.end());
+  appendVarint(bytes, ids.size());
+  size_t controlStart = bytes.size();
+  bytes.resize(bytes.size() + (ids.size() + 3) / 4, 0);
+  uint32_t previous = 0;
+  for (size_t i = 0; i < ids.size(); i++) {
+    uint32_t delta = ids[i] - previous;
+    previous = ids[i];
+    int length = delta < (1u << 8) ? 1 : delta < (1u << 16) ? 2 : delta < (1u << 24) ? 3 : 4;
+    bytes[controlStart + i / 4] |= (length - 1) << (2 * (i % 4));
+    for (int b = 0; b < length; b++) bytes.push_back(delta >> (8 * b));
+  }
+}
+
+vector<unsigned char> compressedTable::encode(const vector<string>& names, const vector<vector<int>>& lists,
+                                              const vector<signed char>& years) {
+  size_t numRecords = names.size();
+  size_t numBlocks = (numRecords + kNamesPerBlock - 1) / kNamesPerBlock;
+  vector<uint32_t> blockOffsets;
+  vector<unsigned char> nameBytes;
+  for (size_t i = 0; i < numRecords; i++) {
+    if (i % kNamesPerBlock == 0) {
+      blockOffsets.push_back(nameBytes.size());
+      appendBytes(nameBytes, names[i].c_str(), names[i].size() + 1);
+      continue;
+    }
+    const string& previous = names[i - 1];
+    size_t shared = 0;
+    while (shared < previous.size() && shared < names[i].size() && previous[shared] == names[i][shared]) shared++;
+    appendVarint(nameBytes, shared);
+    appendBytes(nameBytes, names[i].c_str() + shared, names[i].size() - shared + 1);
+  }
+  while (nameBytes.size() % 4 != 0) nameBytes.push_back(0);
+
+  vector<uint32_t> listOffsets;
+  vector<unsigned char> listBytes;
+  for (const vector<int>& list: lists) {
+    listOffsets.push_back(listBytes.size());
+    appendList(listBytes, list);
+  }
+  listOffsets.push_back(listBytes.size());
+  listBytes.resize(listBytes.size() + kListPadding, 0);
+
+  fileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.numRecords = numRecords;
+  header.numBlocks = numBlocks;
+  header.hasYears = !years.empty();
+  header.blocksOffset = sizeof(fileHeader);
+  header.namesOffset = header.blocksOffset + 4 * numBlocks;
+  header.listOffsetsOffset = header.namesOffset + nameBytes.size();
+  header.listsOffset = header.listOffsetsOffset + 4 * listOffsets.size();
+  header.yearsOffset = header.listsOffset + listBytes.size();
+
+  vector<unsigned char> bytes;
+  appendBytes(bytes, &header, sizeof(header));
+  appendBytes(bytes, blockOffsets.data(), 4 * blockOffsets.size());
+  appendBytes(bytes, nameBytes.data(), nameBytes.size());
+  appendBytes(bytes, listOffsets.data(), 4 * listOffsets.size());
+  appendBytes(bytes, listBytes.data(), listBytes.size());
+  appendBytes(bytes, years.data(), years.size());
+  return bytes;
+}
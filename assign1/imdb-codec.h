@@ -0,0 +1,157 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * Struct: idCursor
+ * ----------------
+ * Position within one compressed id list, as handed out by
+ * compressedTable::getList and advanced by compressedTable::decodeIds.
+ */
+struct idCursor {
+  const unsigned char *control;
+  const unsigned char *data;
+  uint32_t remaining;
+  uint32_t previous;
+};
+
+/**
+ * Class: compressedTable
+ * ----------------------
+ * Read-only view of a compressed (version 2) actordata or moviedata file,
+ * which holds the same information as the original format in a fraction of
+ * the space:
+ *
+ *   - records are numbered in sorted order (the numbers are the same dense
+ *     ids the graph uses), so credits and casts are lists of ids rather than
+ *     lists of 4-byte file offsets;
+ *   - names are front-coded: each block of kNamesPerBlock sorted names opens
+ *     with one name in full, and every other name records only how many
+ *     leading bytes it shares with its predecessor, followed by the rest;
+ *   - each id list is sorted, delta encoded, and packed as a varint count
+ *     followed by stream-vbyte data (one control byte per four deltas, two
+ *     bits apiece giving each delta's length in bytes, then the delta bytes);
+ *   - a movie's year is a single byte (year - 1900) in a separate array.
+ *
+ * Lists are decoded four deltas at a time with SSSE3 shuffles on processors
+ * that support them, and one delta at a time everywhere else.
+ */
+class compressedTable {
+ public:
+  static const int kNamesPerBlock = 16;
+  static const size_t kDecodeBatch = 64;
+
+  compressedTable() : header(NULL) {}
+
+/**
+ * Method: attach
+ * --------------
+ * Points the table at the specified memory-mapped file and returns true, or
+ * returns false (leaving the table detached) if the file isn't a well-formed
+ * compressed file.
+ */
+
+  bool attach(const void *file, size_t fileSize);
+  bool isAttached() const { return header != NULL; }
+  int size() const;
+  size_t getIndexSize() const; // bytes up to the names: the header and the block offsets lowerBound searches
+
+/**
+ * Methods: getName
+ *          getYear
+ * ----------------
+ * Return the name (or title) and year of the record with the specified id.
+ * The name is decoded into scratch, so the pointer returned is only good
+ * until scratch is next changed.  getYear is only meaningful for moviedata.
+ */
+
+  const char *getName(int id, std::string& scratch) const;
+  int getYear(int id) const;
+
+/**
+ * Methods: getList
+ *          decodeIds
+ * ------------------
+ * getList returns a cursor over the ids listed for the specified record, and
+ * each call to decodeIds writes the next (up to) kDecodeBatch of them to ids
+ * and returns how many it wrote, which is 0 once the list is exhausted.
+ */
+
+  idCursor getList(int id) const;
+  static size_t decodeIds(idCursor& cursor, int *ids);
+
+/**
+ * Method: lowerBound
+ * ------------------
+ * Returns the smallest id whose record isn't less than some key, or size()
+ * if every record is.  isLess(name, id) reports whether the record with the
+ * specified id and (decoded) name is less than the key.  The blocks are
+ * binary searched on their leading names, and then at most one block is
+ * decoded.
+ */
+
+  template <typename Predicate>
+  int lowerBound(Predicate isLess) const;
+
+/**
+ * Method: encode
+ * --------------
+ * Returns the bytes of a compressed file holding the specified sorted names,
+ * the id lists that go with them, and (for moviedata) the year bytes, which
+ * should otherwise be empty.
+ */
+
+  static std::vector<unsigned char> encode(const std::vector<std::string>& names,
+                                           const std::vector<std::vector<int>>& lists,
+                                           const std::vector<signed char>& years);
+
+ private:
+  struct fileHeader {
+    int magic;
+    int numRecords;
+    int numBlocks;
+    int hasYears;
+    uint64_t blocksOffset;       // uint32_t offsets of the name blocks within names
+    uint64_t namesOffset;
+    uint64_t listOffsetsOffset;  // numRecords + 1 uint32_t offsets of the lists within lists
+    uint64_t listsOffset;
+    uint64_t yearsOffset;
+  };
+
+  const fileHeader *header;
+  const uint32_t *blockOffsets;
+  const char *names;
+  const uint32_t *listOffsets;
+  const unsigned char *lists;
+  const signed char *years;
+
+  static const int kMagic = 0x325a4d49; // "IMZ2" on disk
+  static const char *nextName(const char *entry, std::string& name);
+};
+
+template <typename Predicate>
+int compressedTable::lowerBound(Predicate isLess) const {
+  int low = 0, high = header->numBlocks; // the answer lies in a block >= low - 1 and < high
+  std::string name;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (isLess(names + blockOffsets[mid], mid * kNamesPerBlock)) low = mid + 1;
+    else high = mid;
+  }
+  if (low == 0) return 0;
+
+  int block = low - 1;
+  int id = block * kNamesPerBlock;
+  int end = std::min(id + kNamesPerBlock, header->numRecords);
+  const char *entry = names + blockOffsets[block];
+  name = entry;
+  entry += name.size() + 1;
+  for (id++; id < end; id++) {
+    entry = nextName(entry, name);
+    if (!isLess(name.c_str(), id)) return id;
+  }
+  return end;
+}
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <getopt.h>
+#include "imdb.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+static const int kDatabaseNotWritten = 3;
+
+static void printUsage(const char *executable) {
+  cerr << "Usage: " << executable << " [--jobs <n>] [<data-directory>]" << endl;
+}
+
+/**
+ * Program: imdb-compact
+ * ---------------------
+ * Folds the credits accumulated in the creditsdelta file (see imdb-delta)
+ * into new actordata and moviedata files, which are verified before the
+ * delta is removed.  The standard data directory is compacted unless
+ * another one is named.  Any graphdata, indexes, landmarks, or hub tables
+ * are removed and need rebuilding afterwards.
+ */
+int main(int argc, char *argv[]) {
+  struct option options[] = {
+    {"jobs", required_argument, NULL, 'j'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t numJobs = max(thread::hardware_concurrency(), 1u);
+  while (true) {
+    int ch = getopt_long(argc, argv, "j:", options, NULL);
+    if (ch == -1) break;
+    if (ch != 'j' || atoi(optarg) <= 0) {
+      printUsage(argv[0]);
+      return kWrongArgumentCount;
+    }
+    numJobs = atoi(optarg);
+  }
+
+  if (argc - optind > 1) {
+    printUsage(argv[0]);
+    return kWrongArgumentCount;
+  }
+
+  string directory = optind < argc ? argv[optind] : kIMDBDataDirectory;
+  imdb db(directory);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in " << directory << "." << endl;
+    return kDatabaseNotFound;
+  }
+
+  if (!db.hasDelta()) {
+    cout << "No up-to-date delta was found in " << directory << "; there's nothing to compact." << endl;
+    return 0;
+  }
+
+  auto start = chrono::steady_clock::now();
+  if (!db.compact(directory, numJobs)) {
+    cerr << "Failed to compact the delta into the database in " << directory << "." << endl;
+    return kDatabaseNotWritten;
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  cout << "Compacted " << db.getNumDeltaCredits() << " credits into the database in " << directory
+       << " in " << elapsed.count() << " seconds." << endl;
+  return 0;
+}
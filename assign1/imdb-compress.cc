@@ -0,0 +1,120 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+#include "imdb.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+static const int kDatabaseNotWritten = 3;
+static const int kVerificationFailed = 4;
+
+static size_t getFileSize(const string& fileName) {
+  struct stat st;
+  return stat(fileName.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+static size_t getDatabaseSize(const string& directory) {
+  return getFileSize(directory + "/actordata") + getFileSize(directory + "/moviedata");
+}
+
+/**
+ * Credits and casts needn't come back in the same order (compressed lists
+ * are sorted by id), so they're compared as sorted lists of names.
+ */
+static vector<string> getCredits(const imdb& db, const string& player) {
+  vector<string> credits;
+  db.forEachCredit(player, [&credits](const char *title, int year, int movieOffset) -> bool {
+    credits.push_back(string(title) + '\0' + to_string(year));
+    return true;
+  });
+  sort(credits.begin(), credits.end());
+  return credits;
+}
+
+static vector<string> getCast(const imdb& db, const film& movie) {
+  vector<string> cast;
+  db.forEachCastMember(movie, [&cast](const char *player, int actorOffset) -> bool {
+    cast.push_back(player);
+    return true;
+  });
+  sort(cast.begin(), cast.end());
+  return cast;
+}
+
+/**
+ * Reads every actor and movie back out of the freshly written database and
+ * confirms that it matches the original, reporting the first mismatch.
+ */
+static bool verify(const imdb& original, const imdb& compressed) {
+  if (original.getNumActors() != compressed.getNumActors() ||
+      original.getNumMovies() != compressed.getNumMovies()) {
+    cerr << "The compressed database holds a different number of actors or movies." << endl;
+    return false;
+  }
+
+  for (int i = 0; i < original.getNumActors(); i++) {
+    string player = original.getActorName(i);
+    if (compressed.getActorName(i) != player || getCredits(original, player) != getCredits(compressed, player)) {
+      cerr << "The compressed database disagrees about " << player << "." << endl;
+      return false;
+    }
+  }
+
+  for (int i = 0; i < original.getNumMovies(); i++) {
+    film movie = original.getMovie(i);
+    if (!(compressed.getMovie(i) == movie) || getCast(original, movie) != getCast(compressed, movie)) {
+      cerr << "The compressed database disagrees about " << movie.title << " (" << movie.year << ")." << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Program: imdb-compress
+ * ----------------------
+ * Rewrites the actordata and moviedata files in the compressed format
+ * described in imdb-codec.h, reads every record back to make sure nothing
+ * was lost, and reports how much smaller the result is.  The database is
+ * read from the standard data directory unless another source directory
+ * is named on the command line.  The destination must differ from the
+ * source, and any graphdata, indexes, landmarks, or hub tables need to be
+ * rebuilt there.
+ */
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    cerr << "Usage: " << argv[0] << " [<source-directory>] <destination-directory>" << endl;
+    return kWrongArgumentCount;
+  }
+
+  string source = argc == 3 ? argv[1] : kIMDBDataDirectory;
+  string destination = argv[argc - 1];
+  imdb db(source);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in " << source << "." << endl;
+    return kDatabaseNotFound;
+  }
+
+  auto start = chrono::steady_clock::now();
+  if (!db.compress(destination)) {
+    cerr << "Failed to write the compressed database to " << destination << "." << endl;
+    return kDatabaseNotWritten;
+  }
+
+  imdb compressed(destination);
+  if (!compressed.good() || !compressed.isCompressed() || !verify(db, compressed)) {
+    cerr << "The compressed database in " << destination << " failed verification." << endl;
+    return kVerificationFailed;
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  size_t before = getDatabaseSize(source), after = getDatabaseSize(destination);
+  cout << "Compressed " << db.getNumActors() << " actors and " << db.getNumMovies() << " movies from "
+       << before << " to " << after << " bytes (" << (before == 0 ? 0 : 100.0 * after / before)
+       << "%) in " << elapsed.count() << " seconds." << endl;
+  return 0;
+}
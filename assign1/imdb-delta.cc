@@ -0,0 +1,110 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <cstdlib>
+#include <getopt.h>
+#include "imdb.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+static const int kCreditsNotFound = 3;
+static const int kMalformedCredits = 4;
+static const int kDeltaNotWritten = 5;
+
+static void printUsage(const char *executable) {
+  cerr << "Usage: " << executable << " [--directory <data-directory>] [<credits-file>]" << endl;
+}
+
+/**
+ * Reads tab-separated (actor, title, year) lines, the same format imdb-build
+ * compiles, skipping blank ones.  Returns false at the first malformed line,
+ * which is left in line.
+ */
+static bool readCredits(istream& in, vector<pair<string, film>>& credits, string& line) {
+  while (getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) continue;
+    size_t firstTab = line.find('\t');
+    size_t secondTab = firstTab == string::npos ? string::npos : line.find('\t', firstTab + 1);
+    if (secondTab == string::npos) return false;
+    char *yearEnd;
+    film movie;
+    movie.title = line.substr(firstTab + 1, secondTab - firstTab - 1);
+    movie.year = strtol(line.c_str() + secondTab + 1, &yearEnd, 10);
+    if (yearEnd == line.c_str() + secondTab + 1 || *yearEnd != '\0') return false;
+    credits.push_back(make_pair(line.substr(0, firstTab), movie));
+  }
+  return true;
+}
+
+/**
+ * Program: imdb-delta
+ * -------------------
+ * Appends tab-separated (actor, title, year) credits, read from the named
+ * file or else standard input, to the creditsdelta file in the standard
+ * data directory (or the one named with --directory), where subsequently
+ * constructed imdbs fold them into getCredits and getCast without the data
+ * files being rebuilt.  Credits the database already has are skipped.  See
+ * imdb-compact for folding the delta back into the data files.
+ */
+int main(int argc, char *argv[]) {
+  struct option options[] = {
+    {"directory", required_argument, NULL, 'd'},
+    {NULL, 0, NULL, 0},
+  };
+
+  string directory = kIMDBDataDirectory;
+  while (true) {
+    int ch = getopt_long(argc, argv, "d:", options, NULL);
+    if (ch == -1) break;
+    if (ch != 'd') {
+      printUsage(argv[0]);
+      return kWrongArgumentCount;
+    }
+    directory = optarg;
+  }
+
+  if (argc - optind > 1) {
+    printUsage(argv[0]);
+    return kWrongArgumentCount;
+  }
+
+  imdb db(directory);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in " << directory << "." << endl;
+    return kDatabaseNotFound;
+  }
+
+  ifstream file;
+  if (optind < argc) {
+    file.open(argv[optind]);
+    if (!file) {
+      cerr << "Failed to open " << argv[optind] << "." << endl;
+      return kCreditsNotFound;
+    }
+  }
+
+  vector<pair<string, film>> credits;
+  string line;
+  if (!readCredits(optind < argc ? file : cin, credits, line)) {
+    cerr << "Malformed credit (expected <actor>\\t<title>\\t<year>): " << line << endl;
+    return kMalformedCredits;
+  }
+
+  auto start = chrono::steady_clock::now();
+  size_t numAdded;
+  if (!db.addCredits(directory, credits, numAdded)) {
+    cerr << "Failed to append the credits to the delta in " << directory
+         << " (a credit may be malformed, or the delta may be out of date)." << endl;
+    return kDeltaNotWritten;
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  cout << "Added " << numAdded << " of " << credits.size() << " credits to the delta in " << directory
+       << " in " << elapsed.count() << " seconds." << endl;
+  return 0;
+}
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "imdb.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+static const int kGraphNotWritten = 3;
+
+/**
+ * Program: imdb-graph-build
+ * -------------------------
+ * Compiles the actordata and moviedata files into a graphdata file
+ * that search (and anything else built on imdb) maps alongside them
+ * and traverses using dense integer ids instead of names.  The
+ * database is read from (and the graph written to) the standard data
+ * directory unless another directory is named on the command line.
+ */
+int main(int argc, char *argv[]) {
+  if (argc > 2) {
+    cerr << "Usage: " << argv[0] << " [<data-directory>]" << endl;
+    return kWrongArgumentCount;
+  }
+
+  string directory = argc == 2 ? argv[1] : kIMDBDataDirectory;
+  imdb db(directory);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in " << directory << "." << endl;
+    return kDatabaseNotFound;
+  }
+
+  auto start = chrono::steady_clock::now();
+  if (!db.compileGraph(directory)) {
+    cerr << "Failed to write the graphdata file to " << directory << "." << endl;
+    return kGraphNotWritten;
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  cout << "Compiled " << db.getNumActors() << " actors and " << db.getNumMovies()
+       << " movies into " << directory << " in " << elapsed.count() << " seconds." << endl;
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <getopt.h>
+#include "imdb.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+static const int kHubNotWritten = 3;
+static const int kGraphNotFound = 4;
+static const int kActorNotFound = 5;
+
+static void printUsage(const char *executable) {
+  cerr << "Usage: " << executable << " [--jobs <n>] [--force] [--directory <data-directory>] <actor> [<actor> ...]" << endl;
+}
+
+/**
+ * Program: imdb-hub-build
+ * -----------------------
+ * Builds a hub table for each of the named actors: a full breadth-first
+ * search from the hub whose distances and parent edges are saved so that
+ * search can answer any query involving that actor by just following
+ * parents.  Hubs whose tables are already up to date are skipped unless
+ * --force is given, and the others are built by up to --jobs threads at
+ * once.  The graphdata file must already have been compiled (see
+ * imdb-graph-build), since the tables are indexed by actor id.
+ */
+int main(int argc, char *argv[]) {
+  struct option options[] = {
+    {"jobs", required_argument, NULL, 'j'},
+    {"force", no_argument, NULL, 'f'},
+    {"directory", required_argument, NULL, 'd'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t numJobs = max(thread::hardware_concurrency(), 1u);
+  bool force = false;
+  string directory = kIMDBDataDirectory;
+  while (true) {
+    int ch = getopt_long(argc, argv, "j:fd:", options, NULL);
+    if (ch == -1) break;
+    switch (ch) {
+    case 'j':
+      if (atoi(optarg) <= 0) {
+        printUsage(argv[0]);
+        return kWrongArgumentCount;
+      }
+      numJobs = atoi(optarg);
+      break;
+    case 'f':
+      force = true;
+      break;
+    case 'd':
+      directory = optarg;
+      break;
+    default:
+      printUsage(argv[0]);
+      return kWrongArgumentCount;
+    }
+  }
+
+  if (optind == argc) {
+    printUsage(argv[0]);
+    return kWrongArgumentCount;
+  }
+
+  imdb db(directory);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in " << directory << "." << endl;
+    return kDatabaseNotFound;
+  }
+
+  if (!db.hasGraph()) {
+    cerr << "No up-to-date graphdata file was found in " << directory << "; run imdb-graph-build first." << endl;
+    return kGraphNotFound;
+  }
+
+  vector<int> hubs;
+  int numUpToDate = 0;
+  for (int i = optind; i < argc; i++) {
+    int hubId = db.getActorId(argv[i]);
+    if (hubId == -1 || hubId >= db.getNumActors()) { // hub tables cover the data files alone
+      cerr << "No actor named " << argv[i] << " was found in the data files." << endl;
+      return kActorNotFound;
+    }
+    if (force || !db.hasHub(hubId)) hubs.push_back(hubId);
+    else numUpToDate++;
+  }
+  sort(hubs.begin(), hubs.end());
+  hubs.erase(unique(hubs.begin(), hubs.end()), hubs.end());
+
+  auto start = chrono::steady_clock::now();
+  atomic<size_t> nextHub(0);
+  atomic<bool> failed(false);
+  mutex coutLock;
+  vector<thread> workers;
+  for (size_t j = 0; j < min(numJobs, hubs.size()); j++) {
+    workers.push_back(thread([&]() {
+      for (size_t i = nextHub++; i < hubs.size(); i = nextHub++) {
+        if (db.buildHub(directory, hubs[i])) continue;
+        lock_guard<mutex> lg(coutLock);
+        cerr << "Failed to write the hub table for " << db.getActorName(hubs[i]) << " to " << directory << "." << endl;
+        failed = true;
+      }
+    }));
+  }
+  for (thread& t: workers) t.join();
+  if (failed) return kHubNotWritten;
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  cout << "Built " << hubs.size() << " hub tables (" << numUpToDate << " already up to date) into " << directory << " in " << elapsed.count() << " seconds." << endl;
+  return 0;
+}
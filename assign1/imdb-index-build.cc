@@ -0,0 +1,43 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "imdb.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+static const int kIndexNotWritten = 3;
+
+/**
+ * Program: imdb-index-build
+ * -------------------------
+ * Builds the actordata.idx and moviedata.idx hash indexes that imdb
+ * maps alongside the data files to look names up in expected constant
+ * time instead of by binary search.  The database is read from (and
+ * the indexes written to) the standard data directory unless another
+ * directory is named on the command line.
+ */
+int main(int argc, char *argv[]) {
+  if (argc > 2) {
+    cerr << "Usage: " << argv[0] << " [<data-directory>]" << endl;
+    return kWrongArgumentCount;
+  }
+
+  string directory = argc == 2 ? argv[1] : kIMDBDataDirectory;
+  imdb db(directory);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in " << directory << "." << endl;
+    return kDatabaseNotFound;
+  }
+
+  auto start = chrono::steady_clock::now();
+  if (!db.buildLookupIndexes(directory)) {
+    cerr << "Failed to write the lookup indexes to " << directory << "." << endl;
+    return kIndexNotWritten;
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  cout << "Indexed " << db.getNumActors() << " actors and " << db.getNumMovies()
+       << " movies into " << directory << " in " << elapsed.count() << " seconds." << endl;
+  return 0;
+}
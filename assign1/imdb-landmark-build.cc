@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <getopt.h>
+#include "imdb.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+static const int kLandmarksNotWritten = 3;
+static const int kGraphNotFound = 4;
+static const int kDefaultNumLandmarks = 16;
+
+static void printUsage(const char *executable) {
+  cerr << "Usage: " << executable << " [--landmarks <n>] [<data-directory>]" << endl;
+}
+
+/**
+ * Program: imdb-landmark-build
+ * ----------------------------
+ * Computes every actor's distance from each of a handful of well-connected
+ * landmark actors and writes them to a landmarks file, which search uses to
+ * bound how far apart two actors can possibly be and so steer its search
+ * toward the target.  The graphdata file must already have been compiled
+ * (see imdb-graph-build), since the distances are indexed by actor id.
+ */
+int main(int argc, char *argv[]) {
+  struct option options[] = {
+    {"landmarks", required_argument, NULL, 'n'},
+    {NULL, 0, NULL, 0},
+  };
+
+  int numLandmarks = kDefaultNumLandmarks;
+  while (true) {
+    int ch = getopt_long(argc, argv, "n:", options, NULL);
+    if (ch == -1) break;
+    if (ch != 'n' || atoi(optarg) <= 0 || atoi(optarg) >= imdb::kUnreachable) {
+      printUsage(argv[0]);
+      return kWrongArgumentCount;
+    }
+    numLandmarks = atoi(optarg);
+  }
+
+  if (argc - optind > 1) {
+    printUsage(argv[0]);
+    return kWrongArgumentCount;
+  }
+
+  string directory = optind < argc ? argv[optind] : kIMDBDataDirectory;
+  imdb db(directory);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in " << directory << "." << endl;
+    return kDatabaseNotFound;
+  }
+
+  if (!db.hasGraph()) {
+    cerr << "No up-to-date graphdata file was found in " << directory << "; run imdb-graph-build first." << endl;
+    return kGraphNotFound;
+  }
+
+  auto start = chrono::steady_clock::now();
+  if (!db.buildLandmarks(directory, numLandmarks)) {
+    cerr << "Failed to write the landmarks file to " << directory << "." << endl;
+    return kLandmarksNotWritten;
+  }
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  imdb updated(directory);
+  cout << "Computed distances from " << updated.getNumLandmarks() << " landmarks to " << db.getNumActors()
+       << " actors into " << directory << " in " << elapsed.count() << " seconds." << endl;
+  return 0;
+}
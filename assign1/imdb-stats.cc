@@ -0,0 +1,333 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <getopt.h>
+#include "imdb.h"
+#include "imdb-builder.h"
+using namespace std;
+
+static const int kWrongArgumentCount = 1;
+static const int kDatabaseNotFound = 2;
+static const int kGraphNotFound = 3;
+
+static void printUsage(const char *executable) {
+  cerr << "Usage: " << executable << " [--jobs <n>] [--samples <n>] [--seed <n>] [<data-directory>]" << endl;
+}
+
+/**
+ * Prints the usual summary statistics of the specified values, followed by
+ * a histogram with power-of-two buckets (0, 1, 2-3, 4-7, and so on) or, for
+ * values known to be small, a bucket per value.
+ */
+static void printDistribution(const string& title, vector<int> values, bool powersOfTwo = true) {
+  cout << title << ":" << endl;
+  if (values.empty()) {
+    cout << "  (none)" << endl << endl;
+    return;
+  }
+
+  sort(values.begin(), values.end());
+  double sum = 0;
+  for (int value: values) sum += value;
+  size_t n = values.size();
+  cout << "  count " << n << ", min " << values.front() << ", median " << values[n / 2]
+       << ", mean " << fixed << setprecision(2) << sum / n << ", p90 " << values[n * 9 / 10]
+       << ", p99 " << values[n * 99 / 100] << ", max " << values.back() << endl;
+
+  for (size_t i = 0; i < n; ) {
+    int low = values[i] == 0 || !powersOfTwo ? values[i] : 1 << (31 - __builtin_clz(values[i]));
+    int high = low == 0 || !powersOfTwo ? low : 2 * low - 1;
+    size_t j = upper_bound(values.begin() + i, values.end(), high) - values.begin();
+    ostringstream bucket;
+    bucket << low;
+    if (high > low) bucket << "-" << high;
+    cout << "  " << setw(15) << bucket.str() << " " << setw(10) << j - i
+         << "  (" << setprecision(2) << 100.0 * (j - i) / n << "%)" << endl;
+    i = j;
+  }
+  cout << endl;
+}
+
+/**
+ * Class: componentForest
+ * ----------------------
+ * Lock-free union-find over actor ids.  Roots are only ever linked beneath
+ * smaller roots, and a link only succeeds if the root being linked is still
+ * a root, so any number of threads can unite at once without forming
+ * cycles.  find halves paths as it goes.
+ */
+class componentForest {
+ public:
+  componentForest(int numActors) : parents(numActors) {
+    for (int i = 0; i < numActors; i++) parents[i].store(i, memory_order_relaxed);
+  }
+
+  int find(int actor) {
+    while (true) {
+      int parent = parents[actor].load(memory_order_relaxed);
+      if (parent == actor) return actor;
+      int grandparent = parents[parent].load(memory_order_relaxed);
+      if (grandparent != parent) parents[actor].compare_exchange_weak(parent, grandparent, memory_order_relaxed);
+      actor = grandparent;
+    }
+  }
+
+  void unite(int first, int second) {
+    while (true) {
+      first = find(first);
+      second = find(second);
+      if (first == second) return;
+      if (first > second) swap(first, second);
+      int expected = second;
+      if (parents[second].compare_exchange_strong(expected, first, memory_order_relaxed)) return;
+    }
+  }
+
+ private:
+  vector<atomic<int>> parents;
+};
+
+/**
+ * Breadth-first search from one actor over the compiled graph, reusing the
+ * caller's arrays (which must arrive filled with -1 and false) and restoring
+ * them before it returns.  Reports the eccentricity of the source, the
+ * farthest actor found, and how many actors lie at each distance.
+ */
+struct sweep {
+  int eccentricity;
+  int farthest;
+  vector<size_t> numAtDistance;
+};
+
+static sweep runSweep(const imdb& db, int source, vector<int>& distances, vector<bool>& moviesSeen) {
+  sweep result;
+  vector<int> reached(1, source), seenMovies;
+  distances[source] = 0;
+  for (size_t i = 0; i < reached.size(); i++) {
+    int player = reached[i];
+    for (int movie: db.getCreditIds(player)) {
+      if (moviesSeen[movie]) continue;
+      moviesSeen[movie] = true;
+      seenMovies.push_back(movie);
+      for (int costar: db.getCastIds(movie)) {
+        if (distances[costar] != -1) continue;
+        distances[costar] = distances[player] + 1;
+        reached.push_back(costar);
+      }
+    }
+  }
+
+  result.farthest = reached.back();
+  result.eccentricity = distances[result.farthest];
+  result.numAtDistance.assign(result.eccentricity + 1, 0);
+  for (int player: reached) {
+    result.numAtDistance[distances[player]]++;
+    distances[player] = -1;
+  }
+  for (int movie: seenMovies) moviesSeen[movie] = false;
+  return result;
+}
+
+static void printDegrees(const imdb& db, size_t numJobs) {
+  int numActors = db.getNumActors(), numMovies = db.getNumMovies();
+  vector<int> credits(numActors), costars(numActors), casts(numMovies);
+  runInParallel(numJobs, numActors, [&](size_t, size_t begin, size_t end) {
+    vector<int> lastSeenBy(numActors, -1);
+    for (size_t i = begin; i < end; i++) {
+      int player = i;
+      credits[i] = db.getCreditIds(player).size();
+      for (int movie: db.getCreditIds(player)) {
+        for (int costar: db.getCastIds(movie)) {
+          if (costar == player || lastSeenBy[costar] == player) continue;
+          lastSeenBy[costar] = player;
+          costars[i]++;
+        }
+      }
+    }
+  });
+  runInParallel(numJobs, numMovies, [&](size_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) casts[i] = db.getCastIds(i).size();
+  });
+  printDistribution("Credits per actor", credits);
+  printDistribution("Distinct costars per actor", costars);
+  printDistribution("Cast members per film", casts);
+}
+
+/**
+ * Returns the actors of the largest component, after printing a summary of
+ * all of them.
+ */
+static vector<int> printComponents(const imdb& db, size_t numJobs) {
+  int numActors = db.getNumActors();
+  componentForest forest(numActors);
+  runInParallel(numJobs, db.getNumMovies(), [&](size_t, size_t begin, size_t end) {
+    for (size_t movie = begin; movie < end; movie++) {
+      idrange cast = db.getCastIds(movie);
+      for (int player: cast) forest.unite(*cast.begin(), player);
+    }
+  });
+
+  vector<int> roots(numActors), sizes(numActors, 0);
+  runInParallel(numJobs, numActors, [&](size_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) roots[i] = forest.find(i);
+  });
+  int numUncredited = 0;
+  for (int i = 0; i < numActors; i++) {
+    if (db.getCreditIds(i).size() == 0) numUncredited++;
+    else sizes[roots[i]]++;
+  }
+  vector<int> componentSizes;
+  int largest = 0;
+  for (int i = 0; i < numActors; i++) {
+    if (sizes[i] == 0) continue;
+    componentSizes.push_back(sizes[i]);
+    if (sizes[i] > sizes[largest]) largest = i;
+  }
+
+  cout << "Connected components: " << componentSizes.size() << ", not counting " << numUncredited
+       << " actors without credits (the largest holds " << sizes[largest] << " actors, or "
+       << fixed << setprecision(2) << 100.0 * sizes[largest] / max(numActors, 1) << "% of them)" << endl;
+  printDistribution("Actors per component", componentSizes);
+
+  vector<int> members;
+  for (int i = 0; i < numActors; i++) if (roots[i] == largest) members.push_back(i);
+  return members;
+}
+
+/**
+ * Sweeps from numSamples random actors of the largest component (on numJobs
+ * threads, each with its own distance array), and again from the actor each
+ * sweep found farthest away.  The farthest any sweep reached is a lower
+ * bound on the diameter, and twice the smallest eccentricity an upper
+ * bound.  The first sweeps also estimate how far apart two random actors
+ * of the component are.
+ */
+static void printEccentricities(const imdb& db, const vector<int>& component, size_t numSamples,
+                                unsigned seed, size_t numJobs) {
+  if (component.size() < 2) return;
+  mt19937 rng(seed);
+  vector<int> samples(numSamples);
+  for (int& sample: samples) sample = component[rng() % component.size()];
+
+  vector<int> eccentricities(numSamples);
+  vector<size_t> numAtDistance;
+  int lowerBound = 0;
+  mutex m;
+  atomic<size_t> nextSample(0);
+  runInParallel(numJobs, numSamples, [&](size_t, size_t, size_t) {
+    vector<int> distances(db.getNumActors(), -1);
+    vector<bool> moviesSeen(db.getNumMovies(), false);
+    for (size_t i = nextSample++; i < numSamples; i = nextSample++) {
+      sweep first = runSweep(db, samples[i], distances, moviesSeen);
+      sweep second = runSweep(db, first.farthest, distances, moviesSeen);
+      lock_guard<mutex> lg(m);
+      eccentricities[i] = first.eccentricity;
+      lowerBound = max(lowerBound, second.eccentricity);
+      if (numAtDistance.size() < first.numAtDistance.size()) numAtDistance.resize(first.numAtDistance.size(), 0);
+      for (size_t d = 0; d < first.numAtDistance.size(); d++) numAtDistance[d] += first.numAtDistance[d];
+    }
+  });
+
+  printDistribution("Eccentricity of " + to_string(numSamples) + " sampled actors in the largest component",
+                    eccentricities, false);
+  cout << "Diameter of the largest component: at least " << lowerBound << ", at most "
+       << 2 * *min_element(eccentricities.begin(), eccentricities.end()) << endl << endl;
+
+  size_t numPairs = 0, numWithinSix = 0;
+  double sum = 0;
+  for (size_t d = 1; d < numAtDistance.size(); d++) {
+    numPairs += numAtDistance[d];
+    sum += d * (double) numAtDistance[d];
+    if (d <= 6) numWithinSix += numAtDistance[d];
+  }
+  cout << "Degrees of separation from the sampled actors (mean " << fixed << setprecision(2)
+       << sum / max<size_t>(numPairs, 1) << "):" << endl;
+  for (size_t d = 1; d < numAtDistance.size(); d++) {
+    cout << "  " << setw(15) << d << " " << setw(10) << numAtDistance[d]
+         << "  (" << 100.0 * numAtDistance[d] / numPairs << "%)" << endl;
+  }
+  cout << "  " << setprecision(2) << 100.0 * numWithinSix / max<size_t>(numPairs, 1)
+       << "% of pairs are within six degrees." << endl << endl;
+}
+
+/**
+ * Program: imdb-stats
+ * -------------------
+ * Reports the shape of the actor/film graph: how credits, costars, and
+ * casts are distributed, how the actors break down into connected
+ * components (found by a lock-free union-find run on every core), and
+ * estimates of the eccentricities, diameter, and typical degrees of
+ * separation within the largest component, from breadth-first sweeps out
+ * of --samples random actors.  Everything is read straight out of the
+ * memory-mapped graphdata file, so beyond it each thread needs only a few
+ * arrays of one entry per actor or film.  The graph must already have been
+ * compiled (see imdb-graph-build).
+ */
+int main(int argc, char *argv[]) {
+  struct option options[] = {
+    {"jobs", required_argument, NULL, 'j'},
+    {"samples", required_argument, NULL, 's'},
+    {"seed", required_argument, NULL, 'S'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t numJobs = max(thread::hardware_concurrency(), 1u);
+  size_t numSamples = 32;
+  unsigned seed = 1;
+  while (true) {
+    int ch = getopt_long(argc, argv, "j:s:S:", options, NULL);
+    if (ch == -1) break;
+    switch (ch) {
+    case 'j':
+    case 's':
+      if (atoi(optarg) <= 0) {
+        printUsage(argv[0]);
+        return kWrongArgumentCount;
+      }
+      (ch == 'j' ? numJobs : numSamples) = atoi(optarg);
+      break;
+    case 'S':
+      seed = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      printUsage(argv[0]);
+      return kWrongArgumentCount;
+    }
+  }
+
+  if (argc - optind > 1) {
+    printUsage(argv[0]);
+    return kWrongArgumentCount;
+  }
+
+  string directory = optind < argc ? argv[optind] : kIMDBDataDirectory;
+  imdb db(directory);
+  if (!db.good()) {
+    cerr << "Failed to properly initialize the imdb database in " << directory << "." << endl;
+    return kDatabaseNotFound;
+  }
+
+  if (!db.hasGraph()) {
+    cerr << "No up-to-date graphdata file was found in " << directory << "; run imdb-graph-build first." << endl;
+    return kGraphNotFound;
+  }
+
+  auto start = chrono::steady_clock::now();
+  cout << db.getNumActors() << " actors and " << db.getNumMovies() << " films in " << directory << "." << endl << endl;
+  printDegrees(db, numJobs);
+  vector<int> component = printComponents(db, numJobs);
+  printEccentricities(db, component, numSamples, seed, numJobs);
+
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  cout << "Computed in " << setprecision(3) << elapsed.count() << " seconds on " << numJobs << " threads." << endl;
+  return 0;
+}
@@ -46,3 +46,20 @@ struct film {
   }
 };
 
+/**
+ * Convenience struct: idrange
+ * ---------------------------
+ * Describes a contiguous run of integer ids living directly inside
+ * one of the imdb's memory mapped files.  Nothing is copied, so the
+ * range is only valid for as long as the imdb that produced it is
+ * alive.  begin and end are provided so that idranges can be
+ * traversed using C++11's range-based for loop.
+ */
+struct idrange {
+  const int *first;
+  const int *last;
+
+  const int *begin() const { return first; }
+  const int *end() const { return last; }
+  size_t size() const { return last - first; }
+};
@@ -1,22 +1,336 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <unistd.h>
 #include "imdb.h"
+#include "imdb-builder.h"
 #include <algorithm>
 #include <vector>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <errno.h>
 #include <assert.h>
 using namespace std;
 
+/**
+ * Every sidecar records which actordata and moviedata files it was derived
+ * from, and is ignored unless the files open match.  Sizes alone aren't
+ * enough, since a database rebuilt in place (by imdb-build or imdb-compact)
+ * can come out exactly the same size, so a data file is identified by its
+ * size, inode number, and modification time as well.  Hashing the contents
+ * would survive copying a database elsewhere, but would read every page of
+ * both files on every open; as it is, sidecars copied along with their data
+ * files just need rebuilding.
+ */
+struct dataFingerprint {
+  int64_t fileSize;
+  int64_t inode;
+  int64_t modifiedTime;
+};
+
+template <typename FileInfo>
+static dataFingerprint getFingerprint(const FileInfo& info) {
+  return { (int64_t) info.fileSize, info.inode, info.modifiedTime };
+}
+
+static bool sameFingerprint(const dataFingerprint& one, const dataFingerprint& two) {
+  return one.fileSize == two.fileSize && one.inode == two.inode && one.modifiedTime == two.modifiedTime;
+}
+
+/**
+ * The graphdata file opens with the following header, and the header
+ * is followed by five int arrays:
+ *
+ *   actorIndex[numActors + 1]: actor i's credits are creditIds[actorIndex[i]] up to creditIds[actorIndex[i + 1]]
+ *   creditIds[numCredits]:     movie ids, each actor's sorted by year (and then id)
+ *   movieIndex[numMovies + 1]: movie j's cast is castIds[movieIndex[j]] up to castIds[movieIndex[j + 1]]
+ *   castIds[numCredits]:       actor ids
+ *   movieYears[numMovies]:     the year of each movie
+ *
+ * The fingerprints of the actordata and moviedata files the graph was
+ * compiled from are recorded so that a graph left over from an older
+ * database is ignored.
+ */
+struct graphHeader {
+  int magic;
+  int numActors;
+  int numMovies;
+  int numCredits;
+  dataFingerprint actorData;
+  dataFingerprint movieData;
+};
+
+static const int kGraphMagic = 0x33525343; // "CSR3" on disk
+
+/**
+ * The landmarks file consists of the following header, the ids of the
+ * numLandmarks landmark actors, and then numLandmarks arrays of numActors
+ * bytes each, the ith holding every actor's distance from the ith landmark.
+ * Distances are capped at kUnreachable - 1, which is far beyond anything
+ * search cares about.  As with graphdata, the data file fingerprints are
+ * recorded so that landmarks computed for an older database are ignored.
+ */
+struct landmarkHeader {
+  int magic;
+  int numLandmarks;
+  int numActors;
+  int numCredits;
+  dataFingerprint actorData;
+  dataFingerprint movieData;
+};
+
+static const int kLandmarkMagic = 0x32544c41; // "ALT2" on disk
+
+/**
+ * Each hub table lives in its own file, named for the hub's actor id, and
+ * consists of the following header, numActors (parent actor, parent movie)
+ * pairs of ints, and numActors distance bytes, all indexed by actor id.
+ * Unreached actors have parents of -1.  The table is ignored if it was built
+ * from an older database or if its file name and hub id disagree.
+ */
+struct hubHeader {
+  int magic;
+  int hubId;
+  int numActors;
+  int numCredits;
+  dataFingerprint actorData;
+  dataFingerprint movieData;
+};
+
+static const int kHubMagic = 0x32425548; // "HUB2" on disk
+
+/**
+ * The creditsdelta file is an append-only log of credits added since the
+ * data files were built.  It opens with the following header, which ties it
+ * to the fingerprints of the data files it amends (a delta left over from an
+ * older database is ignored), and each added credit is then a deltaRecord followed by the
+ * actor's name and the film's title, neither with a terminating '\0'.  A
+ * record cut short by an interrupted append is ignored.
+ */
+struct deltaHeader {
+  int magic;
+  int numActors;
+  int numMovies;
+  int unused;
+  dataFingerprint actorData;
+  dataFingerprint movieData;
+};
+
+struct deltaRecord {
+  int year;
+  int playerLength;
+  int titleLength;
+};
+
+static const int kDeltaMagic = 0x32544c44; // "DLT2" on disk
+
+/**
+ * actordata.idx and moviedata.idx each consist of the following header and
+ * numSlots slots, where numSlots is a power of two at least twice numRecords.
+ * Keys hash to 64 bits: the low bits pick the slot where probing begins and
+ * the high 32 bits are stored in the slot as a fingerprint, so the data file
+ * is only dereferenced (to confirm the match) when fingerprints agree.
+ * Collisions are resolved by linear probing.  No record lives at offset 0
+ * (that's where the record count is), so an offset of 0 marks an empty slot.
+ * The header carries the fingerprint of the data file indexed.
+ */
+struct lookupHeader {
+  int magic;
+  int numRecords;
+  int numSlots;
+  int reserved;
+  dataFingerprint data;
+};
+
+struct lookupSlot {
+  uint32_t fingerprint;
+  int offset;
+};
+
+static const int kLookupMagic = 0x32544f4c; // "LOT2" on disk
+
+/**
+ * FNV-1a over the bytes of the key, followed by a final avalanche so that
+ * the low bits used to pick a slot depend on every byte.  Films hash their
+ * title followed by the same year byte that follows the title on disk.
+ */
+static uint64_t hashBytes(const char *bytes, size_t numBytes, uint64_t hash = 14695981039346656037ULL) {
+  for (size_t i = 0; i < numBytes; i++) {
+    hash ^= (unsigned char) bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64_t finishHash(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static uint64_t hashActor(const char *player) {
+  return finishHash(hashBytes(player, strlen(player)));
+}
+
+static uint64_t hashMovie(const char *title, char yearByte) {
+  return finishHash(hashBytes(&yearByte, 1, hashBytes(title, strlen(title))));
+}
+
+/**
+ * Walks the probe sequence for the specified hash and returns the offset
+ * in the first slot whose fingerprint agrees and whose record the supplied
+ * predicate accepts, or -1 if an empty slot is reached first.
+ */
+template <typename Predicate>
+static int probeLookupIndex(const void *lookup, uint64_t hash, Predicate matches) {
+  const lookupHeader *header = (const lookupHeader *) lookup;
+  const lookupSlot *slots = (const lookupSlot *)(header + 1);
+  uint32_t fingerprint = hash >> 32;
+  size_t mask = header->numSlots - 1;
+  for (size_t i = hash & mask; slots[i].offset != 0; i = (i + 1) & mask) {
+    if (slots[i].fingerprint == fingerprint && matches(slots[i].offset)) return slots[i].offset;
+  }
+  return -1;
+}
+
+/**
+ * Writes the specified chunks to a temporary file and then renames it over
+ * fileName, so that processes still mapping an older copy are never disturbed.
+ */
+static bool writeAtomically(const string& fileName, const vector<pair<const void *, size_t>>& chunks) {
+  const string tempFileName = fileName + ".tmp";
+  ofstream out(tempFileName.c_str(), ios::binary | ios::trunc);
+  for (const pair<const void *, size_t>& chunk: chunks)
+    out.write((const char *) chunk.first, chunk.second);
+  out.close();
+  if (!out) {
+    unlink(tempFileName.c_str());
+    return false;
+  }
+  return rename(tempFileName.c_str(), fileName.c_str()) == 0;
+}
+
+/**
+ * Writes an index holding the specified (hash, record offset) pairs.
+ */
+static bool writeLookupIndex(const string& fileName, const vector<pair<uint64_t, int>>& records,
+                             const dataFingerprint& data) {
+  int numRecords = records.size();
+  int numSlots = 1;
+  while (numSlots < 2 * numRecords) numSlots *= 2;
+  vector<lookupSlot> slots(numSlots, lookupSlot());
+  size_t mask = numSlots - 1;
+  for (const pair<uint64_t, int>& record: records) {
+    size_t slot = record.first & mask;
+    while (slots[slot].offset != 0) slot = (slot + 1) & mask;
+    slots[slot].fingerprint = record.first >> 32;
+    slots[slot].offset = record.second;
+  }
+
+  lookupHeader header = { kLookupMagic, numRecords, numSlots, 0, data };
+  return writeAtomically(fileName, {
+    pair<const void *, size_t>(&header, sizeof(header)),
+    pair<const void *, size_t>(slots.data(), slots.size() * sizeof(lookupSlot))
+  });
+}
+
+/**
+ * Packs the first eight bytes of a name into an integer, most significant
+ * byte first and padded with zero bytes, so that comparing two packed
+ * prefixes as integers orders them exactly as strcmp orders the names
+ * whenever the prefixes differ.
+ */
+static uint64_t packPrefix(const char *name) {
+  uint64_t prefix = 0;
+  for (int i = 0; i < 8; i++) {
+    prefix <<= 8;
+    if (*name != '\0') prefix |= (unsigned char) *name++;
+  }
+  return prefix;
+}
+
+/**
+ * Positions 1 through n of an Eytzinger array form a complete binary tree
+ * stored breadth first (the children of k are 2k and 2k + 1).  These return
+ * the first position in sorted (in-order) order, and the position following
+ * k in sorted order, where 0 means there's no such position.
+ */
+static size_t eytzingerFirst(size_t n) {
+  if (n == 0) return 0;
+  size_t k = 1;
+  while (2 * k <= n) k *= 2;
+  return k;
+}
+
+static size_t eytzingerNext(size_t k, size_t n) {
+  if (2 * k + 1 <= n) {
+    k = 2 * k + 1;
+    while (2 * k <= n) k *= 2;
+    return k;
+  }
+  while (k & 1) k >>= 1;
+  return k >> 1;
+}
+
 const char *const imdb::kActorFileName = "actordata";
 const char *const imdb::kMovieFileName = "moviedata";
-imdb::imdb(const string& directory) {
+const char *const imdb::kGraphFileName = "graphdata";
+const char *const imdb::kLandmarkFileName = "landmarks";
+const char *const imdb::kHubFilePrefix = "hubdata.";
+const char *const imdb::kLookupIndexSuffix = ".idx";
+const char *const imdb::kDeltaFileName = "creditsdelta";
+const unsigned char imdb::kUnreachable;
+imdb::imdb(const string& directory, loadPolicy policy) : graphFile(NULL), actorIndex(NULL), creditIds(NULL),
+                                      movieIndex(NULL), castIds(NULL), movieYears(NULL),
+                                      landmarkFile(NULL), landmarkIds(NULL), landmarkDistances(NULL),
+                                      actorLookup(NULL), movieLookup(NULL), numDeltaCredits(0),
+                                      stopBackgroundLoad(false) {
+  memset(&statistics, 0, sizeof(statistics));
+  statistics.policy = policy;
+  struct rusage before, after;
+  getrusage(RUSAGE_THREAD, &before);
+  auto start = chrono::steady_clock::now();
+  load(directory);
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  getrusage(RUSAGE_THREAD, &after);
+  statistics.loadSeconds = elapsed.count();
+  statistics.minorFaults = after.ru_minflt - before.ru_minflt;
+  statistics.majorFaults = after.ru_majflt - before.ru_majflt;
+  if (policy == kLoadInBackground && good()) backgroundLoader = thread(&imdb::loadInBackground, this);
+}
+
+void imdb::load(const string& directory) {
   const string actorFileName = directory + "/" + kActorFileName;
   const string movieFileName = directory + "/" + kMovieFileName;  
   actorFile = acquireFileMap(actorFileName, actorInfo);
   movieFile = acquireFileMap(movieFileName, movieInfo);
+  bool actorsCompressed = actorTable.attach(actorFile, actorInfo.fileSize);
+  bool moviesCompressed = movieTable.attach(movieFile, movieInfo.fileSize);
+  if (actorsCompressed != moviesCompressed) {
+    releaseFileMap(actorInfo);
+    releaseFileMap(movieInfo);
+  }
+  graphInfo.fd = landmarkInfo.fd = actorLookupInfo.fd = movieLookupInfo.fd = -1;
+  graphInfo.fileMap = landmarkInfo.fileMap = actorLookupInfo.fileMap = movieLookupInfo.fileMap = NULL;
+  if (!good()) return;
+  loadDelta(directory + "/" + kDeltaFileName);
+  actorLookup = loadLookupIndex(actorFileName + kLookupIndexSuffix, actorLookupInfo, actorInfo, getNumActors());
+  movieLookup = loadLookupIndex(movieFileName + kLookupIndexSuffix, movieLookupInfo, movieInfo, getNumMovies());
+  loadGraph(directory + "/" + kGraphFileName);
+  if (!hasGraph()) return;
+  loadLandmarks(directory + "/" + kLandmarkFileName);
+  loadHubs(directory);
 }
 
 bool imdb::good() const {
@@ -25,99 +339,992 @@ bool imdb::good() const {
 }
 
 imdb::~imdb() {
+  stopBackgroundLoad = true;
+  awaitBackgroundLoad();
   releaseFileMap(actorInfo);
   releaseFileMap(movieInfo);
+  releaseFileMap(graphInfo);
+  releaseFileMap(landmarkInfo);
+  for (auto& hub: hubInfo) releaseFileMap(hub.second);
+  releaseFileMap(actorLookupInfo);
+  releaseFileMap(movieLookupInfo);
 }
 
-vector<int> imdb::getRecordNodes(const void *file) const {
-  int numRecord = *((int *) file);
-  int *start = ((int *) file) + 1;
-  vector<int> v(start, start + numRecord);
-  return v;
+bool imdb::isCompressed() const {
+  return actorTable.isAttached();
 }
 
-film imdb::getFilm(char *movieRecord) const {
-  film f;
-  f.title = movieRecord;
-  int titleLen = strlen(movieRecord) + 1;
-  char *year = movieRecord + titleLen;
-  f.year = 1900 + (*year);
-  return f;
+int imdb::getNumRecords(const void *file) const {
+  return isCompressed() ? getTable(file).size() : *(const int *) file;
 }
 
-bool imdb::getCredits(const string& player, vector<film>& films) const {
-  const void *file = actorFile;
-  vector<int> v = getRecordNodes(file);
-  intptr_t target = player.c_str() - (char *) file;
-  vector<int>::iterator lower;
-  lower = lower_bound(v.begin(), v.end(), target, [file](intptr_t l, intptr_t r) -> bool {
-    return strcmp((char *) file + l, (char *) file + r) < 0;
-  });
-  char *actorRecord = (char *) file + (*lower);
-  bool found = strcmp(actorRecord, player.c_str()) == 0;
-  if (!found) return false;
+/**
+ * Actors and movies only the delta has come after those in the file, and
+ * their offsets count down from -2.
+ */
+int imdb::getRecordOffset(const void *file, int id) const {
+  int numRecords = getNumRecords(file);
+  if (id >= numRecords) return -2 - (id - numRecords);
+  return isCompressed() ? id + 1 : ((const int *) file + 1)[id];
+}
+
+const char *imdb::readName(const void *file, int offset, string& scratch) const {
+  if (offset < -1) return file == actorFile ? deltaPlayers[-2 - offset].c_str() : deltaMovies[-2 - offset].title.c_str();
+  return isCompressed() ? getTable(file).getName(offset - 1, scratch) : (const char *) file + offset;
+}
+
+int imdb::readYear(int movieOffset) const {
+  if (movieOffset < -1) return deltaMovies[-2 - movieOffset].year;
+  return isCompressed() ? movieTable.getYear(movieOffset - 1) : getYear((const char *) movieFile + movieOffset);
+}
+
+int imdb::getYear(const char *movieRecord) {
+  const char *year = movieRecord + strlen(movieRecord) + 1;
+  return 1900 + (*year);
+}
+
+const int *imdb::getActorPayload(const char *actorRecord, short& numMovies) {
   int nameLen = strlen(actorRecord) + 1;
   if (nameLen % 2 == 1) nameLen += 1;
   int headerLen = nameLen + 2;
   if (headerLen % 4 != 0) headerLen += 2;
-  short actorNumMovie = *(short *)(actorRecord + nameLen);
-  int *actorMoviePayload = (int *)(actorRecord + headerLen);
-  for (short i = 0; i < actorNumMovie; i++) {
-    int *curr = actorMoviePayload + i;
-    char *movieRecord = (char *) movieFile + (*curr);
-    film f = getFilm(movieRecord);
-    films.push_back(f);
-  }
-  return true;
+  numMovies = *(short *)(actorRecord + nameLen);
+  return (const int *)(actorRecord + headerLen);
 }
 
-bool imdb::getCast(const film& movie, vector<string>& players) const {
-  const void *file = movieFile;
-  vector<int> v = getRecordNodes(file);
-  char *movieCopy = (char *) malloc(strlen(movie.title.c_str()) + 1 + 1);
-  assert(movieCopy != NULL);
-  memcpy(movieCopy, movie.title.c_str(), strlen(movie.title.c_str()) + 1);
-  char year = movie.year - 1900;
-  memcpy(movieCopy + strlen(movie.title.c_str()) + 1, &year, 1);
-  intptr_t target = movieCopy - (char *) file;
-  vector<int>::iterator lower;
-  lower = lower_bound(v.begin(), v.end(), target, [this,file](intptr_t l, intptr_t r) -> bool {
-    film fl = getFilm((char *) file + l);
-    film fr = getFilm((char *) file + r);
-    return fl < fr;
-  });
-  char *movieRecord = (char *) file + (*lower);
-  film movie_found = getFilm(movieRecord);
-  bool found = movie_found == movie;
-  if (!found) {
-    players.clear();
-    return false;
-  }
+const int *imdb::getMoviePayload(const char *movieRecord, short& numActors) {
   int nameLen = strlen(movieRecord) + 1 + 1;
   if (nameLen % 2 == 1) nameLen += 1;
   int headerLen = nameLen + 2;
   if (headerLen % 4 != 0) headerLen += 2;
-  short movieNumActor = *(short *)(movieRecord + nameLen);
-  int *movieActorPayload = (int *)(movieRecord + headerLen);
-  for (short i = 0; i < movieNumActor; i++) {
-    int *curr = movieActorPayload + i;
-    char *actorRecord = (char *) actorFile + (*curr);
-    string player = actorRecord;
+  numActors = *(short *)(movieRecord + nameLen);
+  return (const int *)(movieRecord + headerLen);
+}
+
+bool imdb::getCredits(const string& player, vector<film>& films) const {
+  return forEachCredit(player, [&films](const char *title, int year, int movieOffset) -> bool {
+    film f;
+    f.title = title;
+    f.year = year;
+    films.push_back(f);
+    return true;
+  });
+}
+
+bool imdb::getCast(const film& movie, vector<string>& players) const {
+  bool found = forEachCastMember(movie, [&players](const char *player, int actorOffset) -> bool {
     players.push_back(player);
+    return true;
+  });
+  if (!found) players.clear();
+  return found;
+}
+
+int imdb::getActorOffset(const string& player) const {
+  if (actorLookup != NULL) {
+    int actorOffset = lookupActor(player);
+    if (actorOffset != -1) return actorOffset;
+    auto delta = deltaPlayerIndex.find(player);
+    return delta == deltaPlayerIndex.end() ? -1 : -2 - delta->second;
+  }
+  int actorId = getActorId(player);
+  if (actorId == -1) return -1;
+  return getRecordOffset(actorFile, actorId);
+}
+
+int imdb::getMovieOffset(const film& movie) const {
+  if (movieLookup != NULL) {
+    int movieOffset = lookupMovie(movie);
+    if (movieOffset != -1) return movieOffset;
+    auto delta = deltaMovieIndex.find(movie);
+    return delta == deltaMovieIndex.end() ? -1 : -2 - delta->second;
+  }
+  int movieId = getMovieId(movie);
+  if (movieId == -1) return -1;
+  return getRecordOffset(movieFile, movieId);
+}
+
+string imdb::getActorNameAt(int actorOffset) const {
+  string name;
+  return readName(actorFile, actorOffset, name);
+}
+
+film imdb::getMovieAt(int movieOffset) const {
+  string scratch;
+  film f;
+  f.title = readName(movieFile, movieOffset, scratch);
+  f.year = readYear(movieOffset);
+  return f;
+}
+
+bool imdb::hasGraph() const {
+  return graphFile != NULL;
+}
+
+int imdb::getNumActors() const {
+  return getNumRecords(actorFile);
+}
+
+int imdb::getNumMovies() const {
+  return getNumRecords(movieFile);
+}
+
+int imdb::getActorId(const string& player) const {
+  if (isCompressed()) {
+    int actorId = actorTable.lowerBound([&player](const char *name, int id) -> bool {
+      return strcmp(name, player.c_str()) < 0;
+    });
+    if (actorId < getNumActors() && getActorName(actorId) == player) return actorId;
+  } else {
+    const int *offsets = (const int *) actorFile + 1;
+    const int *end = offsets + getNumActors();
+    const char *file = (const char *) actorFile;
+    const int *lower = lower_bound(offsets, end, player.c_str(), [file](int offset, const char *name) -> bool {
+      return strcmp(file + offset, name) < 0;
+    });
+    if (lower != end && strcmp(file + *lower, player.c_str()) == 0) return lower - offsets;
+  }
+  auto delta = deltaPlayerIndex.find(player);
+  return delta == deltaPlayerIndex.end() ? -1 : getNumActors() + delta->second;
+}
+
+/**
+ * Films are compared in place: titles with strcmp and, only when the titles
+ * match, years via the byte that follows the title (or, when compressed,
+ * the byte in the years array).
+ */
+int imdb::getMovieId(const film& movie) const {
+  if (isCompressed()) {
+    int movieId = movieTable.lowerBound([this, &movie](const char *title, int id) -> bool {
+      int cmp = strcmp(title, movie.title.c_str());
+      return cmp < 0 || (cmp == 0 && movieTable.getYear(id) < movie.year);
+    });
+    if (movieId < getNumMovies() && getMovie(movieId) == movie) return movieId;
+  } else {
+    const int *offsets = (const int *) movieFile + 1;
+    const int *end = offsets + getNumMovies();
+    const char *file = (const char *) movieFile;
+    const int *lower = lower_bound(offsets, end, movie, [file](int offset, const film& movie) -> bool {
+      int cmp = strcmp(file + offset, movie.title.c_str());
+      return cmp < 0 || (cmp == 0 && getYear(file + offset) < movie.year);
+    });
+    if (lower != end && strcmp(file + *lower, movie.title.c_str()) == 0 && getYear(file + *lower) == movie.year) {
+      return lower - offsets;
+    }
+  }
+  auto delta = deltaMovieIndex.find(movie);
+  return delta == deltaMovieIndex.end() ? -1 : getNumMovies() + delta->second;
+}
+
+string imdb::getActorName(int actorId) const {
+  return getActorNameAt(getRecordOffset(actorFile, actorId));
+}
+
+film imdb::getMovie(int movieId) const {
+  return getMovieAt(getRecordOffset(movieFile, movieId));
+}
+
+idrange imdb::getCreditIds(int actorId) const {
+  if (actorId >= getNumActors()) return idrange{ creditIds, creditIds };
+  idrange credits = { creditIds + actorIndex[actorId], creditIds + actorIndex[actorId + 1] };
+  return credits;
+}
+
+/**
+ * Each actor's credits are sorted by year, so the window is found by binary
+ * searching the years of the movies they list.
+ */
+idrange imdb::getCreditIds(int actorId, int fromYear, int toYear) const {
+  idrange credits = getCreditIds(actorId);
+  const int *years = movieYears;
+  credits.first = lower_bound(credits.first, credits.last, fromYear, [years](int movie, int year) -> bool {
+    return years[movie] < year;
+  });
+  credits.last = upper_bound(credits.first, credits.last, toYear, [years](int year, int movie) -> bool {
+    return year < years[movie];
+  });
+  return credits;
+}
+
+int imdb::getMovieYear(int movieId) const {
+  return movieId < getNumMovies() ? movieYears[movieId] : deltaMovies[movieId - getNumMovies()].year;
+}
+
+bool imdb::getCreditsInRange(const string& player, int fromYear, int toYear, vector<film>& films) const {
+  size_t first = films.size();
+  int actorId = hasGraph() ? getActorId(player) : -1;
+  bool found;
+  if (actorId != -1) {
+    for (int movie: getCreditIds(actorId, fromYear, toYear)) films.push_back(getMovie(movie));
+    forEachDeltaCreditId(actorId, [this, &films](int movie) -> bool {
+      films.push_back(getMovie(movie));
+      return true;
+    });
+    found = true;
+  } else {
+    found = getCredits(player, films);
+  }
+  films.erase(remove_if(films.begin() + first, films.end(), [fromYear, toYear](const film& movie) -> bool {
+    return movie.year < fromYear || movie.year > toYear;
+  }), films.end());
+  stable_sort(films.begin() + first, films.end(), [](const film& lhs, const film& rhs) -> bool {
+    return lhs.year < rhs.year;
+  });
+  return found;
+}
+
+idrange imdb::getCastIds(int movieId) const {
+  if (movieId >= getNumMovies()) return idrange{ castIds, castIds };
+  idrange cast = { castIds + movieIndex[movieId], castIds + movieIndex[movieId + 1] };
+  return cast;
+}
+
+/**
+ * Ids are positions within the sorted offset tables, so the only real work
+ * is mapping every record offset found in a payload back to its position.
+ * The graph is written to a temporary file and then renamed into place so
+ * that processes still mapping an older graphdata are never disturbed.
+ */
+bool imdb::compileGraph(const string& directory) const {
+  int numActors = getNumActors();
+  int numMovies = getNumMovies();
+  unordered_map<int, int> actorOffsetIds(numActors), movieOffsetIds(numMovies);
+  for (int i = 0; i < numActors; i++) actorOffsetIds[getRecordOffset(actorFile, i)] = i;
+  for (int i = 0; i < numMovies; i++) movieOffsetIds[getRecordOffset(movieFile, i)] = i;
+
+  vector<int> years(numMovies);
+  for (int i = 0; i < numMovies; i++) years[i] = readYear(getRecordOffset(movieFile, i));
+
+  vector<int> actorRows(1, 0), credits;
+  for (int i = 0; i < numActors; i++) {
+    forEachListedOffset(actorFile, getRecordOffset(actorFile, i), [&](int movieOffset) -> bool {
+      credits.push_back(movieOffsetIds.at(movieOffset));
+      return true;
+    });
+    sort(credits.begin() + actorRows.back(), credits.end(), [&years](int lhs, int rhs) -> bool {
+      return years[lhs] < years[rhs] || (years[lhs] == years[rhs] && lhs < rhs);
+    });
+    actorRows.push_back(credits.size());
+  }
+
+  vector<int> movieRows(1, 0), cast;
+  for (int i = 0; i < numMovies; i++) {
+    forEachListedOffset(movieFile, getRecordOffset(movieFile, i), [&](int actorOffset) -> bool {
+      cast.push_back(actorOffsetIds.at(actorOffset));
+      return true;
+    });
+    movieRows.push_back(cast.size());
+  }
+
+  if (credits.size() != cast.size()) return false; // actordata and moviedata disagree
+  graphHeader header = { kGraphMagic, numActors, numMovies, (int) credits.size(),
+                         getFingerprint(actorInfo), getFingerprint(movieInfo) };
+  return writeAtomically(directory + "/" + kGraphFileName, {
+    pair<const void *, size_t>(&header, sizeof(header)),
+    pair<const void *, size_t>(actorRows.data(), actorRows.size() * sizeof(int)),
+    pair<const void *, size_t>(credits.data(), credits.size() * sizeof(int)),
+    pair<const void *, size_t>(movieRows.data(), movieRows.size() * sizeof(int)),
+    pair<const void *, size_t>(cast.data(), cast.size() * sizeof(int)),
+    pair<const void *, size_t>(years.data(), years.size() * sizeof(int))
+  });
+}
+
+bool imdb::hasLandmarks() const {
+  return landmarkFile != NULL;
+}
+
+int imdb::getNumLandmarks() const {
+  return hasLandmarks() ? ((const landmarkHeader *) landmarkFile)->numLandmarks : 0;
+}
+
+int imdb::getLandmarkActorId(int landmark) const {
+  return landmarkIds[landmark];
+}
+
+const unsigned char *imdb::getLandmarkDistances(int landmark) const {
+  return landmarkDistances + (size_t) landmark * getNumActors();
+}
+
+/**
+ * Fills distances with the number of degrees separating every actor from
+ * the specified one, by a plain breadth-first search over the CSR arrays.
+ * If parents isn't NULL, the (actor, movie) pair each actor was first reached
+ * through is recorded in parents[2 * id] and parents[2 * id + 1].
+ */
+void imdb::computeDistances(int source, vector<unsigned char>& distances, int *parents) const {
+  fill(distances.begin(), distances.end(), kUnreachable);
+  vector<bool> movieSeen(getNumMovies(), false);
+  vector<int> frontier(1, source), next;
+  distances[source] = 0;
+  if (parents != NULL) {
+    fill(parents, parents + 2 * (size_t) getNumActors(), -1);
+    parents[2 * source] = source;
+  }
+  for (int degree = 1; !frontier.empty(); degree++) {
+    unsigned char distance = min(degree, kUnreachable - 1);
+    for (int player: frontier) {
+      for (int movie: getCreditIds(player)) {
+        if (movieSeen[movie]) continue;
+        movieSeen[movie] = true;
+        for (int costar: getCastIds(movie)) {
+          if (distances[costar] != kUnreachable) continue;
+          distances[costar] = distance;
+          if (parents != NULL) {
+            parents[2 * costar] = player;
+            parents[2 * costar + 1] = movie;
+          }
+          next.push_back(costar);
+        }
+      }
+    }
+    frontier.swap(next);
+    next.clear();
+  }
+}
+
+/**
+ * Landmarks are chosen greedily in order of decreasing number of credits,
+ * passing over anyone who costarred with a landmark already chosen, since two
+ * landmarks that close together bound distances almost identically.
+ */
+bool imdb::buildLandmarks(const string& directory, int numLandmarks) const {
+  if (!hasGraph() || numLandmarks <= 0) return false;
+  int numActors = getNumActors();
+  vector<int> candidates(numActors);
+  for (int i = 0; i < numActors; i++) candidates[i] = i;
+  stable_sort(candidates.begin(), candidates.end(), [this](int one, int two) {
+    return actorIndex[one + 1] - actorIndex[one] > actorIndex[two + 1] - actorIndex[two];
+  });
+
+  vector<int> landmarks;
+  vector<unsigned char> distances, landmarkDistances(numActors);
+  for (int candidate: candidates) {
+    if ((int) landmarks.size() == numLandmarks) break;
+    bool tooClose = false;
+    for (size_t l = 0; l < landmarks.size() && !tooClose; l++)
+      tooClose = distances[l * numActors + candidate] <= 1;
+    if (tooClose) continue;
+    computeDistances(candidate, landmarkDistances, NULL);
+    landmarks.push_back(candidate);
+    distances.insert(distances.end(), landmarkDistances.begin(), landmarkDistances.end());
+  }
+
+  const graphHeader *graph = (const graphHeader *) graphFile;
+  landmarkHeader header = { kLandmarkMagic, (int) landmarks.size(), numActors, graph->numCredits,
+                            getFingerprint(actorInfo), getFingerprint(movieInfo) };
+  return writeAtomically(directory + "/" + kLandmarkFileName, {
+    pair<const void *, size_t>(&header, sizeof(header)),
+    pair<const void *, size_t>(landmarks.data(), landmarks.size() * sizeof(int)),
+    pair<const void *, size_t>(distances.data(), distances.size())
+  });
+}
+
+bool imdb::hasHub(int hubId) const {
+  return hubInfo.find(hubId) != hubInfo.end();
+}
+
+int imdb::getHubDistance(int hubId, int actorId) const {
+  const hubHeader *header = (const hubHeader *) hubInfo.at(hubId).fileMap;
+  const int *parents = (const int *)(header + 1);
+  return ((const unsigned char *)(parents + 2 * (size_t) header->numActors))[actorId];
+}
+
+bool imdb::getHubParent(int hubId, int actorId, int& parentId, int& movieId) const {
+  const int *parents = (const int *)((const hubHeader *) hubInfo.at(hubId).fileMap + 1);
+  parentId = parents[2 * actorId];
+  movieId = parents[2 * actorId + 1];
+  return parentId != -1;
+}
+
+bool imdb::buildHub(const string& directory, int hubId) const {
+  if (!hasGraph() || hubId < 0 || hubId >= getNumActors()) return false;
+  int numActors = getNumActors();
+  vector<unsigned char> distances(numActors);
+  vector<int> parents(2 * (size_t) numActors);
+  computeDistances(hubId, distances, parents.data());
+  hubHeader header = { kHubMagic, hubId, numActors, ((const graphHeader *) graphFile)->numCredits,
+                       getFingerprint(actorInfo), getFingerprint(movieInfo) };
+  return writeAtomically(directory + "/" + kHubFilePrefix + to_string(hubId), {
+    pair<const void *, size_t>(&header, sizeof(header)),
+    pair<const void *, size_t>(parents.data(), parents.size() * sizeof(int)),
+    pair<const void *, size_t>(distances.data(), distances.size())
+  });
+}
+
+bool imdb::hasLookupIndexes() const {
+  return actorLookup != NULL && movieLookup != NULL;
+}
+
+bool imdb::buildLookupIndexes(const string& directory) const {
+  vector<pair<uint64_t, int>> actors, movies;
+  string name;
+  for (int i = 0; i < getNumActors(); i++) {
+    int actorOffset = getRecordOffset(actorFile, i);
+    actors.push_back(make_pair(hashActor(readName(actorFile, actorOffset, name)), actorOffset));
+  }
+  for (int i = 0; i < getNumMovies(); i++) {
+    int movieOffset = getRecordOffset(movieFile, i);
+    const char *title = readName(movieFile, movieOffset, name);
+    movies.push_back(make_pair(hashMovie(title, readYear(movieOffset) - 1900), movieOffset));
+  }
+  bool actorsWritten = writeLookupIndex(directory + "/" + kActorFileName + kLookupIndexSuffix,
+                                        actors, getFingerprint(actorInfo));
+  bool moviesWritten = writeLookupIndex(directory + "/" + kMovieFileName + kLookupIndexSuffix,
+                                        movies, getFingerprint(movieInfo));
+  return actorsWritten && moviesWritten;
+}
+
+/**
+ * Names are read out of this imdb and compressed in id order, which is sorted
+ * order.  The lists are translated from record offsets to ids on the way.
+ */
+bool imdb::compress(const string& directory) const {
+  int numActors = getNumActors();
+  int numMovies = getNumMovies();
+  unordered_map<int, int> actorOffsetIds(numActors), movieOffsetIds(numMovies);
+  for (int i = 0; i < numActors; i++) actorOffsetIds[getRecordOffset(actorFile, i)] = i;
+  for (int i = 0; i < numMovies; i++) movieOffsetIds[getRecordOffset(movieFile, i)] = i;
+
+  vector<string> names(numActors);
+  vector<vector<int>> lists(numActors);
+  for (int i = 0; i < numActors; i++) {
+    int actorOffset = getRecordOffset(actorFile, i);
+    names[i] = getActorNameAt(actorOffset);
+    forEachListedOffset(actorFile, actorOffset, [&](int movieOffset) -> bool {
+      lists[i].push_back(movieOffsetIds.at(movieOffset));
+      return true;
+    });
+  }
+  vector<unsigned char> actorBytes = compressedTable::encode(names, lists, vector<signed char>());
+
+  vector<signed char> years(numMovies);
+  names.assign(numMovies, string());
+  lists.assign(numMovies, vector<int>());
+  for (int i = 0; i < numMovies; i++) {
+    film movie = getMovie(i);
+    names[i] = movie.title;
+    years[i] = movie.year - 1900;
+    forEachListedOffset(movieFile, getRecordOffset(movieFile, i), [&](int actorOffset) -> bool {
+      lists[i].push_back(actorOffsetIds.at(actorOffset));
+      return true;
+    });
+  }
+  vector<unsigned char> movieBytes = compressedTable::encode(names, lists, years);
+
+  return writeAtomically(directory + "/" + kActorFileName, {
+      pair<const void *, size_t>(actorBytes.data(), actorBytes.size())
+    }) && writeAtomically(directory + "/" + kMovieFileName, {
+      pair<const void *, size_t>(movieBytes.data(), movieBytes.size())
+    });
+}
+
+/**
+ * The data files' matches and the delta's come out sorted on their own, so
+ * up to limit of each are gathered and the two lists merged.
+ */
+bool imdb::prefixSearch(const string& prefix, size_t limit, vector<string>& players) const {
+  vector<string> matches, deltaMatches;
+  forEachPrefixMatch(actorFile, getPrefixEntries(actorFile, actorPrefixes, actorPrefixesBuilt),
+                     prefix, limit, [&](int offset) {
+    matches.push_back(getActorNameAt(offset));
+  });
+  for (auto delta = deltaPlayerIndex.lower_bound(prefix);
+       delta != deltaPlayerIndex.end() && deltaMatches.size() < limit &&
+       delta->first.compare(0, prefix.size(), prefix) == 0; ++delta) {
+    deltaMatches.push_back(delta->first);
+  }
+  size_t first = players.size();
+  merge(matches.begin(), matches.end(), deltaMatches.begin(), deltaMatches.end(), back_inserter(players));
+  if (players.size() - first > limit) players.resize(first + limit);
+  return players.size() > first;
+}
+
+bool imdb::prefixSearch(const string& prefix, size_t limit, vector<film>& films) const {
+  vector<film> matches, deltaMatches;
+  forEachPrefixMatch(movieFile, getPrefixEntries(movieFile, moviePrefixes, moviePrefixesBuilt),
+                     prefix, limit, [&](int offset) {
+    matches.push_back(getMovieAt(offset));
+  });
+  for (auto delta = deltaMovieIndex.lower_bound(film{prefix, INT_MIN});
+       delta != deltaMovieIndex.end() && deltaMatches.size() < limit &&
+       delta->first.title.compare(0, prefix.size(), prefix) == 0; ++delta) {
+    deltaMatches.push_back(delta->first);
+  }
+  size_t first = films.size();
+  merge(matches.begin(), matches.end(), deltaMatches.begin(), deltaMatches.end(), back_inserter(films));
+  if (films.size() - first > limit) films.resize(first + limit);
+  return films.size() > first;
+}
+
+/**
+ * Builds the Eytzinger array for the specified data file the first time it's
+ * needed.  call_once makes this safe even if several threads ask at once.
+ */
+const vector<imdb::prefixEntry>& imdb::getPrefixEntries(const void *file, vector<prefixEntry>& entries,
+                                                        once_flag& built) const {
+  call_once(built, [this, file, &entries]() {
+    size_t numRecords = getNumRecords(file);
+    entries.resize(numRecords + 1);
+    string name;
+    size_t i = 0;
+    for (size_t k = eytzingerFirst(numRecords); k != 0; k = eytzingerNext(k, numRecords), i++) {
+      entries[k].offset = getRecordOffset(file, i);
+      entries[k].prefix = packPrefix(readName(file, entries[k].offset, name));
+    }
+  });
+  return entries;
+}
+
+/**
+ * Descends from the root to find the first name that isn't less than the
+ * prefix (the branch-free descent ends at a leaf, and the trailing one bits
+ * of k record the right turns taken after the last left turn, so shifting
+ * them off recovers the answer).  Packed prefixes settle every comparison
+ * except ties on prefixes longer than eight bytes.  Matches are then visited
+ * in sorted order by stepping to in-order successors.
+ */
+template <typename Visitor>
+void imdb::forEachPrefixMatch(const void *file, const vector<prefixEntry>& entries,
+                              const string& prefix, size_t limit, Visitor visit) const {
+  string name;
+  size_t n = entries.size() - 1;
+  uint64_t packed = packPrefix(prefix.c_str());
+  size_t k = 1;
+  while (k <= n) {
+    const prefixEntry& entry = entries[k];
+    bool less = entry.prefix < packed ||
+      (entry.prefix == packed && prefix.size() > 8 && strcmp(readName(file, entry.offset, name), prefix.c_str()) < 0);
+    k = 2 * k + less;
+  }
+  k >>= __builtin_ffsll(~k);
+
+  for (size_t numVisited = 0; k != 0 && numVisited < limit; k = eytzingerNext(k, n), numVisited++) {
+    if (strncmp(readName(file, entries[k].offset, name), prefix.c_str(), prefix.size()) != 0) return;
+    visit(entries[k].offset);
+  }
+}
+
+int imdb::lookupActor(const string& player) const {
+  string name;
+  return probeLookupIndex(actorLookup, hashActor(player.c_str()), [this, &player, &name](int offset) -> bool {
+    return strcmp(readName(actorFile, offset, name), player.c_str()) == 0;
+  });
+}
+
+int imdb::lookupMovie(const film& movie) const {
+  string title;
+  char yearByte = movie.year - 1900;
+  return probeLookupIndex(movieLookup, hashMovie(movie.title.c_str(), yearByte),
+                          [this, &movie, &title](int offset) -> bool {
+    return strcmp(readName(movieFile, offset, title), movie.title.c_str()) == 0 && readYear(offset) == movie.year;
+  });
+}
+
+void imdb::loadGraph(const string& fileName) {
+  graphFile = acquireFileMap(fileName, graphInfo);
+  if (graphFile == NULL) return;
+  const graphHeader *header = (const graphHeader *) graphFile;
+  bool valid = graphInfo.fileSize >= sizeof(graphHeader) &&
+    header->magic == kGraphMagic &&
+    header->numActors == getNumActors() && header->numMovies == getNumMovies() &&
+    sameFingerprint(header->actorData, getFingerprint(actorInfo)) &&
+    sameFingerprint(header->movieData, getFingerprint(movieInfo)) &&
+    graphInfo.fileSize == sizeof(graphHeader) +
+      sizeof(int) * (header->numActors + 2 * (size_t) header->numMovies + 2 + 2 * (size_t) header->numCredits);
+  if (!valid) {
+    releaseFileMap(graphInfo);
+    graphFile = NULL;
+    return;
+  }
+
+  actorIndex = (const int *)(header + 1);
+  creditIds = actorIndex + header->numActors + 1;
+  movieIndex = creditIds + header->numCredits;
+  castIds = movieIndex + header->numMovies + 1;
+  movieYears = castIds + header->numCredits;
+}
+
+void imdb::loadLandmarks(const string& fileName) {
+  landmarkFile = acquireFileMap(fileName, landmarkInfo);
+  if (landmarkFile == NULL) return;
+  const landmarkHeader *header = (const landmarkHeader *) landmarkFile;
+  bool valid = landmarkInfo.fileSize >= sizeof(landmarkHeader) &&
+    header->magic == kLandmarkMagic &&
+    header->numActors == getNumActors() &&
+    header->numCredits == ((const graphHeader *) graphFile)->numCredits &&
+    sameFingerprint(header->actorData, getFingerprint(actorInfo)) &&
+    sameFingerprint(header->movieData, getFingerprint(movieInfo)) &&
+    header->numLandmarks >= 0 &&
+    landmarkInfo.fileSize == sizeof(landmarkHeader) +
+      header->numLandmarks * (sizeof(int) + (size_t) header->numActors);
+  if (!valid) {
+    releaseFileMap(landmarkInfo);
+    landmarkFile = NULL;
+    return;
+  }
+
+  landmarkIds = (const int *)(header + 1);
+  landmarkDistances = (const unsigned char *)(landmarkIds + header->numLandmarks);
+}
+
+void imdb::loadHubs(const string& directory) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == NULL) return;
+  const size_t prefixLength = strlen(kHubFilePrefix);
+  while (true) {
+    struct dirent *entry = readdir(dir);
+    if (entry == NULL) break;
+    const char *name = entry->d_name;
+    if (strncmp(name, kHubFilePrefix, prefixLength) != 0) continue;
+    char *end;
+    long hubId = strtol(name + prefixLength, &end, 10);
+    if (end == name + prefixLength || *end != '\0') continue; // e.g. a .tmp left by a crashed build
+
+    struct fileInfo info;
+    const hubHeader *header = (const hubHeader *) acquireFileMap(directory + "/" + name, info);
+    bool valid = header != NULL && info.fileSize >= sizeof(hubHeader) &&
+      header->magic == kHubMagic && header->hubId == hubId &&
+      header->numActors == getNumActors() &&
+      header->numCredits == ((const graphHeader *) graphFile)->numCredits &&
+      sameFingerprint(header->actorData, getFingerprint(actorInfo)) &&
+      sameFingerprint(header->movieData, getFingerprint(movieInfo)) &&
+      info.fileSize == sizeof(hubHeader) + (2 * sizeof(int) + 1) * (size_t) header->numActors;
+    if (valid) hubInfo[hubId] = info;
+    else releaseFileMap(info);
   }
-  free(movieCopy);
-  return true;
+  closedir(dir);
 }
 
+const void *imdb::loadLookupIndex(const string& fileName, struct fileInfo& info,
+                                  const struct fileInfo& dataInfo, int numRecords) {
+  const void *lookup = acquireFileMap(fileName, info);
+  if (lookup == NULL) return NULL;
+  const lookupHeader *header = (const lookupHeader *) lookup;
+  bool valid = info.fileSize >= sizeof(lookupHeader) &&
+    header->magic == kLookupMagic &&
+    header->numRecords == numRecords &&
+    sameFingerprint(header->data, getFingerprint(dataInfo)) &&
+    header->numSlots > 0 && (header->numSlots & (header->numSlots - 1)) == 0 &&
+    info.fileSize == sizeof(lookupHeader) + header->numSlots * sizeof(lookupSlot);
+  if (!valid) {
+    releaseFileMap(info);
+    return NULL;
+  }
+  return lookup;
+}
+
+/**
+ * Sidecars that turn out to be stale are mapped (and so populated, advised,
+ * or locked) before they're released, which costs some wasted reading under
+ * the eager policies but is rare enough not to be worth checking headers
+ * through read beforehand.
+ */
 const void *imdb::acquireFileMap(const string& fileName, struct fileInfo& info) {
+  info.fileSize = 0;
+  info.inode = info.modifiedTime = 0;
+  info.fileMap = NULL;
+  info.fd = open(fileName.c_str(), O_RDONLY);
+  if (info.fd == -1) return NULL;
   struct stat stats;
-  stat(fileName.c_str(), &stats);
+  fstat(info.fd, &stats);
   info.fileSize = stats.st_size;
-  info.fd = open(fileName.c_str(), O_RDONLY);
-  return info.fileMap = mmap(0, info.fileSize, PROT_READ, MAP_SHARED, info.fd, 0);
+  info.inode = stats.st_ino;
+  info.modifiedTime = stats.st_mtim.tv_sec * 1000000000LL + stats.st_mtim.tv_nsec;
+  loadPolicy policy = statistics.policy;
+  int flags = MAP_SHARED | (policy == kLoadPopulated ? MAP_POPULATE : 0);
+  info.fileMap = mmap(0, info.fileSize, PROT_READ, flags, info.fd, 0);
+  if (info.fileMap == MAP_FAILED) {
+    info.fileMap = NULL;
+    return NULL;
+  }
+
+  void *map = (void *) info.fileMap;
+  bool applied = false;
+  switch (policy) {
+  case kLoadPopulated: applied = true; break;
+  case kLoadWillNeed: applied = madvise(map, info.fileSize, MADV_WILLNEED) == 0; break;
+  case kLoadRandom: applied = madvise(map, info.fileSize, MADV_RANDOM) == 0; break;
+  case kLoadHugePages: applied = madvise(map, info.fileSize, MADV_HUGEPAGE) == 0; break;
+  case kLoadLocked: applied = mlock(map, info.fileSize) == 0; break;
+  default: break;
+  }
+  statistics.mappedBytes += info.fileSize;
+  if (applied) statistics.appliedBytes += info.fileSize;
+  return info.fileMap;
+}
+
+static const char *const kLoadPolicyNames[] = {
+  "lazy", "populate", "willneed", "random", "hugepage", "mlock", "background"
+};
+
+const char *imdb::getLoadPolicyName(loadPolicy policy) {
+  return kLoadPolicyNames[policy];
+}
+
+bool imdb::parseLoadPolicy(const string& name, loadPolicy& policy) {
+  for (int i = 0; i < kNumLoadPolicies; i++) {
+    if (name == kLoadPolicyNames[i]) {
+      policy = (loadPolicy) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const imdb::loadStatistics& imdb::getLoadStatistics() const {
+  return statistics;
+}
+
+void imdb::awaitBackgroundLoad() {
+  if (backgroundLoader.joinable()) backgroundLoader.join();
+}
+
+/**
+ * The offset tables (or the compressed block indexes) go first, since every
+ * lookup without a lookup index starts with a binary search over them, then
+ * the lookup indexes and the graph, which path searches lean on, and only
+ * then the records themselves.  The destructor can stop the thread early.
+ */
+void imdb::loadInBackground() {
+  struct rusage before, after;
+  getrusage(RUSAGE_THREAD, &before);
+  auto start = chrono::steady_clock::now();
+  size_t actorIndexSize = isCompressed() ? actorTable.getIndexSize() : sizeof(int) * (getNumActors() + 1);
+  size_t movieIndexSize = isCompressed() ? movieTable.getIndexSize() : sizeof(int) * (getNumMovies() + 1);
+  const atomic<bool> *stop = &stopBackgroundLoad;
+  prefaultFileMap(actorInfo, 0, actorIndexSize, stop);
+  prefaultFileMap(movieInfo, 0, movieIndexSize, stop);
+  prefaultFileMap(actorLookupInfo, 0, SIZE_MAX, stop);
+  prefaultFileMap(movieLookupInfo, 0, SIZE_MAX, stop);
+  prefaultFileMap(graphInfo, 0, SIZE_MAX, stop);
+  prefaultFileMap(landmarkInfo, 0, SIZE_MAX, stop);
+  for (const auto& hub: hubInfo) prefaultFileMap(hub.second, 0, SIZE_MAX, stop);
+  prefaultFileMap(actorInfo, actorIndexSize, SIZE_MAX, stop);
+  prefaultFileMap(movieInfo, movieIndexSize, SIZE_MAX, stop);
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  getrusage(RUSAGE_THREAD, &after);
+  statistics.backgroundSeconds = elapsed.count();
+  statistics.backgroundMinorFaults = after.ru_minflt - before.ru_minflt;
+  statistics.backgroundMajorFaults = after.ru_majflt - before.ru_majflt;
+}
+
+bool imdb::hasDelta() const {
+  return numDeltaCredits > 0;
+}
+
+size_t imdb::getNumDeltaCredits() const {
+  return numDeltaCredits;
+}
+
+int imdb::getNumDeltaActors() const {
+  return deltaPlayers.size();
+}
+
+int imdb::getNumDeltaMovies() const {
+  return deltaMovies.size();
+}
+
+/**
+ * Each credit is resolved as it's read: actors and films missing from the
+ * data files are numbered as they first turn up, so that every later
+ * credit naming them finds them already in the delta.
+ */
+void imdb::loadDelta(const string& fileName) {
+  ifstream in(fileName.c_str(), ios::binary);
+  deltaHeader header;
+  if (!in.read((char *) &header, sizeof(header))) return;
+  if (header.magic != kDeltaMagic || header.numActors != getNumActors() || header.numMovies != getNumMovies() ||
+      !sameFingerprint(header.actorData, getFingerprint(actorInfo)) ||
+      !sameFingerprint(header.movieData, getFingerprint(movieInfo))) {
+    return;
+  }
+
+  deltaRecord record;
+  while (in.read((char *) &record, sizeof(record))) {
+    if (record.playerLength <= 0 || record.titleLength <= 0) break;
+    string player(record.playerLength, '\0');
+    film movie;
+    movie.title.assign(record.titleLength, '\0');
+    movie.year = record.year;
+    if (!in.read(&player[0], player.size()) || !in.read(&movie.title[0], movie.title.size())) break;
+    int actorId = getActorId(player);
+    if (actorId == -1) {
+      actorId = getNumActors() + deltaPlayers.size();
+      deltaPlayerIndex[player] = deltaPlayers.size();
+      deltaPlayers.push_back(player);
+    }
+    int movieId = getMovieId(movie);
+    if (movieId == -1) {
+      movieId = getNumMovies() + deltaMovies.size();
+      deltaMovieIndex[movie] = deltaMovies.size();
+      deltaMovies.push_back(movie);
+    }
+    int actorOffset = getRecordOffset(actorFile, actorId);
+    int movieOffset = getRecordOffset(movieFile, movieId);
+    deltaCredits[actorOffset].push_back(deltaEdge{movieOffset, movieId});
+    deltaCasts[movieOffset].push_back(deltaEdge{actorOffset, actorId});
+    numDeltaCredits++;
+  }
+}
+
+/**
+ * The records are all assembled first and appended with a single write, so
+ * a reader never sees part of a batch unless the write itself is cut short.
+ * Credits already in the batch are found by hashing the actor, title, and
+ * year, joined by '\0's (which neither name can contain), and those already
+ * in the database by walking the actor's credits.
+ */
+bool imdb::addCredits(const string& directory, const vector<pair<string, film>>& credits, size_t& numAdded) const {
+  numAdded = 0;
+  string records;
+  unordered_set<string> added;
+  for (const pair<string, film>& c: credits) {
+    const string& player = c.first;
+    const film& movie = c.second;
+    if (player.empty() || movie.title.empty() || movie.year < 1900 + SCHAR_MIN || movie.year > 1900 + SCHAR_MAX ||
+        player.find('\0') != string::npos || movie.title.find('\0') != string::npos) {
+      return false;
+    }
+    bool credited = false;
+    forEachCredit(player, [&movie, &credited](const char *title, int year, int movieOffset) -> bool {
+      credited = year == movie.year && movie.title == title;
+      return !credited;
+    });
+    if (credited || !added.insert(player + '\0' + movie.title + '\0' + to_string(movie.year)).second) continue;
+    deltaRecord record = { movie.year, (int) player.size(), (int) movie.title.size() };
+    records.append((const char *) &record, sizeof(record));
+    records += player;
+    records += movie.title;
+  }
+
+  const string fileName = directory + "/" + kDeltaFileName;
+  int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd == -1) return false;
+  deltaHeader header = { kDeltaMagic, getNumActors(), getNumMovies(), 0,
+                         getFingerprint(actorInfo), getFingerprint(movieInfo) };
+  deltaHeader existing;
+  ssize_t headerSize = pread(fd, &existing, sizeof(existing), 0);
+  bool matches = headerSize == sizeof(existing) && memcmp(&existing, &header, sizeof(header)) == 0;
+  if (headerSize == 0) records.insert(0, (const char *) &header, sizeof(header));
+  else if (!matches) {
+    close(fd);
+    return false;
+  }
+
+  for (size_t written = 0; written < records.size(); ) {
+    ssize_t count = write(fd, records.data() + written, records.size() - written);
+    if (count == -1) {
+      close(fd);
+      return false;
+    }
+    written += count;
+  }
+  numAdded = added.size();
+  return close(fd) == 0;
+}
+
+/**
+ * Every actor, film, and credit in the data files and the delta is gathered
+ * up (names are copied, since a compressed database only ever decodes them
+ * into scratch space) and handed to buildDatabase, just as imdb-build would.
+ * Actors and films are passed along on their own as well, so that any
+ * without credits survive.
+ */
+bool imdb::compact(const string& directory, size_t numJobs) const {
+  int numActors = getNumActors();
+  int numMovies = getNumMovies();
+  vector<string> players(numActors);
+  vector<film> movies(numMovies);
+  unordered_map<int, int> movieOffsetIds(numMovies);
+  for (int i = 0; i < numActors; i++) players[i] = getActorName(i);
+  for (int i = 0; i < numMovies; i++) {
+    movies[i] = getMovie(i);
+    movieOffsetIds[getRecordOffset(movieFile, i)] = i;
+  }
+
+  vector<credit> credits;
+  for (int i = 0; i < numActors; i++) {
+    credit c = { players[i].c_str(), NULL, 0 };
+    credits.push_back(c);
+    forEachListedOffset(actorFile, getRecordOffset(actorFile, i), [&](int movieOffset) -> bool {
+      const film& movie = movies[movieOffsetIds.at(movieOffset)];
+      credit c = { players[i].c_str(), movie.title.c_str(), movie.year };
+      credits.push_back(c);
+      return true;
+    });
+  }
+  for (const film& movie: movies) {
+    credit c = { NULL, movie.title.c_str(), movie.year };
+    credits.push_back(c);
+  }
+  vector<string> deltaNames;
+  vector<film> deltaFilms;
+  for (const auto& delta: deltaCredits) {
+    for (const deltaEdge& edge: delta.second) {
+      deltaNames.push_back(getActorNameAt(delta.first));
+      deltaFilms.push_back(getMovieAt(edge.offset));
+    }
+  }
+  for (size_t i = 0; i < deltaNames.size(); i++) {
+    credit c = { deltaNames[i].c_str(), deltaFilms[i].title.c_str(), deltaFilms[i].year };
+    credits.push_back(c);
+  }
+
+  databaseSummary summary;
+  string problem;
+  if (buildDatabase(credits, directory, numJobs, summary, problem) != kBuildSucceeded) return false;
+  if (isCompressed()) {
+    imdb compacted(directory);
+    if (!compacted.good() || !compacted.compress(directory)) return false;
+  }
+  return removeDelta(directory);
+}
+
+static bool removeFile(const string& fileName) {
+  return unlink(fileName.c_str()) == 0 || errno == ENOENT;
+}
+
+bool imdb::removeSidecars(const string& directory) {
+  bool removed = removeFile(directory + "/" + kGraphFileName);
+  removed = removeFile(directory + "/" + kLandmarkFileName) && removed;
+  removed = removeFile(directory + "/" + kActorFileName + kLookupIndexSuffix) && removed;
+  removed = removeFile(directory + "/" + kMovieFileName + kLookupIndexSuffix) && removed;
+  DIR *dir = opendir(directory.c_str());
+  if (dir == NULL) return removed && errno == ENOENT;
+  while (struct dirent *entry = readdir(dir)) {
+    if (strncmp(entry->d_name, kHubFilePrefix, strlen(kHubFilePrefix)) != 0) continue;
+    removed = removeFile(directory + "/" + entry->d_name) && removed;
+  }
+  closedir(dir);
+  return removed;
+}
+
+bool imdb::removeDelta(const string& directory) {
+  return removeFile(directory + "/" + kDeltaFileName);
+}
+
+size_t imdb::prefault() const {
+  size_t numPages = prefaultFileMap(actorInfo) + prefaultFileMap(movieInfo) + prefaultFileMap(graphInfo) +
+    prefaultFileMap(landmarkInfo) + prefaultFileMap(actorLookupInfo) + prefaultFileMap(movieLookupInfo);
+  for (const auto& hub: hubInfo) numPages += prefaultFileMap(hub.second);
+  return numPages;
+}
+
+size_t imdb::prefaultFileMap(const struct fileInfo& info, size_t begin, size_t end, const atomic<bool> *stop) {
+  if (info.fileMap == NULL) return 0;
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  const volatile char *bytes = (const volatile char *) info.fileMap;
+  size_t numPages = 0;
+  for (size_t offset = begin / pageSize * pageSize; offset < min(end, info.fileSize); offset += pageSize, numPages++) {
+    if (stop != NULL && *stop) break;
+    bytes[offset];
+  }
+  return numPages;
 }
 
 void imdb::releaseFileMap(struct fileInfo& info) {
   if (info.fileMap != NULL) munmap((char *) info.fileMap, info.fileSize);
   if (info.fd != -1) close(info.fd);
+  info.fileMap = NULL;
+  info.fd = -1;
 }
@@ -1,10 +1,78 @@
 #pragma once
 #include "imdb-utils.h"
+#include "imdb-codec.h"
 #include <string>
 #include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <stdint.h>
 
 class imdb {
  public:
+
+/**
+ * Enum: loadPolicy
+ * ----------------
+ * How the constructor maps the files backing an imdb into memory:
+ *
+ *     kLoadLazily:       plain mmap, with every page faulted in by the query that first needs it
+ *     kLoadPopulated:    mmap with MAP_POPULATE, so the constructor reads everything in up front
+ *     kLoadWillNeed:     madvise(MADV_WILLNEED), which starts asynchronous readahead of every file
+ *     kLoadRandom:       madvise(MADV_RANDOM), which turns readahead off for scattered lookups
+ *     kLoadHugePages:    madvise(MADV_HUGEPAGE), honored where the kernel backs file pages with huge pages
+ *     kLoadLocked:       mlock, which faults everything in and pins it (up to RLIMIT_MEMLOCK)
+ *     kLoadInBackground: plain mmap plus a thread that touches every page, offset tables first
+ */
+
+  enum loadPolicy {
+    kLoadLazily,
+    kLoadPopulated,
+    kLoadWillNeed,
+    kLoadRandom,
+    kLoadHugePages,
+    kLoadLocked,
+    kLoadInBackground
+  };
+
+  static const int kNumLoadPolicies = kLoadInBackground + 1;
+
+/**
+ * Methods: getLoadPolicyName
+ * --------------------------
+ * Translate between load policies and the names tools accept on the command
+ * line: lazy, populate, willneed, random, hugepage, mlock, and background.
+ * parseLoadPolicy returns false if the name isn't one of them.
+ */
+
+  static const char *getLoadPolicyName(loadPolicy policy);
+  static bool parseLoadPolicy(const std::string& name, loadPolicy& policy);
+
+/**
+ * Struct: loadStatistics
+ * ----------------------
+ * What loading an imdb cost: the time the constructor took and the page
+ * faults it took along the way, and how much of the mapped data was locked
+ * into memory or advised (a policy's system call can fail, as mlock does
+ * beyond RLIMIT_MEMLOCK, in which case the imdb still works, just lazily).
+ * The background thread's time and faults are reported separately, and only
+ * once it has finished (see awaitBackgroundLoad).
+ */
+
+  struct loadStatistics {
+    loadPolicy policy;
+    double loadSeconds;
+    long minorFaults;
+    long majorFaults;
+    size_t mappedBytes;
+    size_t appliedBytes;      // bytes the policy's mmap flag, madvise, or mlock succeeded on
+    double backgroundSeconds;
+    long backgroundMinorFaults;
+    long backgroundMajorFaults;
+  };
   
 /**
  * Constructor: imdb
@@ -16,9 +84,10 @@ class imdb {
  * application (like six-degrees).
  *
  * @param directory the name of the directory housing the formatted information backing the imdb.
+ * @param policy how eagerly the files are brought into memory (see loadPolicy).
  */
 
-  imdb(const std::string& directory);
+  imdb(const std::string& directory, loadPolicy policy = kLoadLazily);
 
 /**
  * Predicate Method: good
@@ -40,6 +109,7 @@ class imdb {
  * of credits is returned via the second argument, which you'll note
  * is a non-const vector<film> reference.  If the specified actor/actress
  * isn't in the database, then the films vector will be left empty.
+ * Credits added by a delta (see addCredits) follow those in actordata.
  *
  * @param player the name of the actor or actresses being queried.
  * @param films a reference to the vector of films that should be updated
@@ -56,7 +126,8 @@ class imdb {
  * Searches the receiving imdb for the specified film and returns the cast
  * by populating the specified vector<string> with the list of actors and actresses
  * who star in it.  If the movie doesn't exist in the database, the players vector
- * is cleared and its size left at 0.
+ * is cleared and its size left at 0.  Cast members added by a delta (see
+ * addCredits) follow those in moviedata.
  *
  * @param movie the film (title and year) being queried
  * @param players a reference to the vector of strings to be updated with the
@@ -69,6 +140,381 @@ class imdb {
 
   bool getCast(const film& movie, std::vector<std::string>& players) const;
 
+/**
+ * Method: getCreditsInRange
+ * -------------------------
+ * Like getCredits, except that only the films made between fromYear and
+ * toYear (inclusive) are appended, and they're appended in order of year.
+ * Given a compiled graph, whose credit lists are sorted by year, the window
+ * is found by binary search; otherwise every credit is read and filtered.
+ */
+
+  bool getCreditsInRange(const std::string& player, int fromYear, int toYear, std::vector<film>& films) const;
+
+/**
+ * Methods: forEachCredit
+ *          forEachCastMember
+ * --------------------------
+ * Zero-allocation versions of getCredits and getCast.  Rather than building
+ * a vector, they invoke the supplied visitor once per credit (or cast member),
+ * handing it pointers directly into the memory-mapped files (or, when the
+ * database is compressed, into a buffer reused from one call to the next, so
+ * the pointers are only good for the duration of the call):
+ *
+ *    bool visit(const char *title, int year, int movieOffset);  // forEachCredit
+ *    bool visit(const char *player, int actorOffset);           // forEachCastMember
+ *
+ * The visitor returns true to keep going and false to stop early.  The
+ * offsets identify the records themselves and can be handed back to the
+ * offset-based overloads, which skip the name lookup altogether.  (A
+ * compressed database has no records to speak of, and its offsets are just
+ * ids plus one.)  Credits and cast members added by a delta follow those in
+ * the data files, and actors and films that only the delta knows about have
+ * offsets of -2 and below.  The name-based versions return true if and only
+ * if the actor or film was found.
+ */
+
+  template <typename Visitor>
+  bool forEachCredit(const std::string& player, Visitor visit) const;
+  template <typename Visitor>
+  void forEachCredit(int actorOffset, Visitor visit) const;
+  template <typename Visitor>
+  bool forEachCastMember(const film& movie, Visitor visit) const;
+  template <typename Visitor>
+  void forEachCastMember(int movieOffset, Visitor visit) const;
+
+/**
+ * Methods: getActorOffset
+ *          getMovieOffset
+ *          getActorNameAt
+ *          getMovieAt
+ * -----------------------
+ * Translate between names and the record offsets passed to visitors.  The
+ * lookups return -1 if the actor or film isn't in the database; the reverse
+ * mappings assume the offset came from one of the methods above.
+ */
+
+  int getActorOffset(const std::string& player) const;
+  int getMovieOffset(const film& movie) const;
+  std::string getActorNameAt(int actorOffset) const;
+  film getMovieAt(int movieOffset) const;
+
+/**
+ * Predicate Method: hasGraph
+ * --------------------------
+ * Returns true if and only if the data directory also housed an up-to-date
+ * graphdata file (as produced by compileGraph), in which case the id-based
+ * methods below can be used to traverse the actor/movie graph without ever
+ * touching a name.  A graphdata file built from a different actordata or
+ * moviedata is ignored.
+ */
+
+  bool hasGraph() const;
+
+/**
+ * Methods: getNumActors
+ *          getNumMovies
+ * ---------------------
+ * Return the number of actors and movies in the data files.  Actor ids
+ * range from 0 through getNumActors() - 1, and movie ids range from
+ * 0 through getNumMovies() - 1.  Ids are assigned in sorted order, so
+ * an id is simply a position within the sorted list of names.  Actors
+ * and movies that only the delta knows about are numbered from there on
+ * (see getNumDeltaActors).
+ */
+
+  int getNumActors() const;
+  int getNumMovies() const;
+
+/**
+ * Method: getActorId
+ * ------------------
+ * Returns the dense integer id of the specified actor/actress, or -1
+ * if the actor/actress isn't in the database.
+ */
+
+  int getActorId(const std::string& player) const;
+
+/**
+ * Methods: getActorName
+ *          getMovie
+ * -----------------
+ * Map ids back to the names (and, in the case of movies, the years)
+ * they stand for.  The ids must be in range.
+ */
+
+  std::string getActorName(int actorId) const;
+  film getMovie(int movieId) const;
+
+/**
+ * Methods: getCreditIds
+ *          getCastIds
+ *          getMovieYear
+ * -------------------
+ * Return the ids of the movies the specified actor appeared in (sorted by
+ * year, and optionally limited to those made between fromYear and toYear
+ * inclusive), the ids of the actors starring in the specified movie, and
+ * the year a movie was made.  The ranges point directly into the
+ * memory-mapped graphdata file, so nothing is allocated or copied, and
+ * hold only what the data files do (see forEachDeltaCreditId for the rest).
+ * Only meaningful when hasGraph() returns true.
+ */
+
+  idrange getCreditIds(int actorId) const;
+  idrange getCreditIds(int actorId, int fromYear, int toYear) const;
+  idrange getCastIds(int movieId) const;
+  int getMovieYear(int movieId) const;
+
+/**
+ * Method: compileGraph
+ * --------------------
+ * Builds a compressed-sparse-row version of the bipartite actor/movie
+ * graph and writes it to the graphdata file within the specified directory,
+ * where subsequently constructed imdbs will pick it up.  Returns true if
+ * and only if the file was written without incident.
+ */
+
+  bool compileGraph(const std::string& directory) const;
+
+/**
+ * Predicate Method: isCompressed
+ * ------------------------------
+ * Returns true if and only if the actordata and moviedata files are in the
+ * compressed format written by compress, which every method decodes
+ * transparently.  (A directory with one file in each format isn't good.)
+ */
+
+  bool isCompressed() const;
+
+/**
+ * Method: compress
+ * ----------------
+ * Writes compressed actordata and moviedata files, holding exactly what this
+ * imdb holds, to the specified directory: names are front-coded, credits
+ * and casts become delta-encoded lists of ids (so each comes back in sorted
+ * order), and years take a single byte.  See compressedTable for the details.
+ * Any graphdata, index, landmarks, or hub tables in that directory are
+ * left stale and need rebuilding.  Returns true if and only if both files
+ * were written without incident.
+ */
+
+  bool compress(const std::string& directory) const;
+
+/**
+ * Methods: hasDelta
+ *          getNumDeltaCredits
+ *          getNumDeltaActors
+ *          getNumDeltaMovies
+ * ---------------------------
+ * Report whether an up-to-date creditsdelta file (as appended to by
+ * addCredits) was found alongside the data files, how many credits it
+ * adds, and how many of the actors and movies it names aren't in the data
+ * files at all.  The delta is resolved against the data files as the imdb
+ * is constructed, and every name, offset, and id based method sees it; only
+ * the graphdata arrays, landmarks, and hub tables, which are built from the
+ * data files, don't until the delta is compacted into them.
+ */
+
+  bool hasDelta() const;
+  size_t getNumDeltaCredits() const;
+  int getNumDeltaActors() const;
+  int getNumDeltaMovies() const;
+
+/**
+ * Methods: forEachDeltaCreditId
+ *          forEachDeltaCastId
+ * ---------------------------
+ * Invoke the supplied visitor once per movie id the delta adds to the
+ * specified actor's credits, or once per actor id it adds to the specified
+ * movie's cast, which is to say everything getCreditIds and getCastIds
+ * leave out:
+ *
+ *    bool visit(int id);
+ *
+ * The visitor returns true to keep going and false to stop early.  Any id
+ * from getActorId (or getCastIds) can be passed.
+ */
+
+  template <typename Visitor>
+  void forEachDeltaCreditId(int actorId, Visitor visit) const;
+  template <typename Visitor>
+  void forEachDeltaCastId(int movieId, Visitor visit) const;
+
+/**
+ * Method: addCredits
+ * ------------------
+ * Appends the specified (actor, film) credits to the creditsdelta file in
+ * the specified directory, creating it if need be, and reports how many
+ * were appended via numAdded.  Credits already present, in the data files
+ * or the delta, are skipped.  Neither this imdb nor the data files change;
+ * imdbs constructed afterwards pick the new credits up.  Returns false,
+ * having appended nothing, if a credit is malformed (an empty name or a
+ * year that can't be stored) or the existing delta belongs to some other
+ * version of the data files.
+ */
+
+  bool addCredits(const std::string& directory, const std::vector<std::pair<std::string, film>>& credits,
+                  size_t& numAdded) const;
+
+/**
+ * Method: compact
+ * ---------------
+ * Folds the delta into new actordata and moviedata files (compressed if
+ * these are), writes them to the specified directory using numJobs
+ * threads (see buildDatabase), verifies them, and then removes any delta
+ * from that directory, which is usually the one this imdb was opened on.
+ * Any graphdata, indexes, landmarks, or hub tables in that directory are
+ * removed and need rebuilding.  Returns true if and only if all of that
+ * went without incident.
+ */
+
+  bool compact(const std::string& directory, size_t numJobs) const;
+
+/**
+ * Static Methods: removeSidecars, removeDelta
+ * -------------------------------------------
+ * Remove, from the specified directory, the files derived from its data
+ * files (graphdata, the lookup indexes, landmarks, and hub tables) or the
+ * creditsdelta file amending them, which buildDatabase does whenever it
+ * replaces the data files there.  Files that aren't there are fine.  Each
+ * returns true if and only if nothing was left behind.
+ */
+
+  static bool removeSidecars(const std::string& directory);
+  static bool removeDelta(const std::string& directory);
+
+/**
+ * Methods: hasLandmarks
+ *          getNumLandmarks
+ *          getLandmarkActorId
+ *          getLandmarkDistances
+ * ------------------------------
+ * Expose the landmarks file (as produced by buildLandmarks), if an up-to-date
+ * one was found alongside the graph.  Landmark i is the actor whose id is
+ * getLandmarkActorId(i), and getLandmarkDistances(i) is an array, indexed by
+ * actor id, of the number of degrees separating each actor from that landmark,
+ * with kUnreachable standing in for actors not connected to it at all.  The
+ * triangle inequality turns these into lower bounds on the degrees separating
+ * any two actors.  hasLandmarks() is never true unless hasGraph() is.
+ */
+
+  static const unsigned char kUnreachable = 255;
+  bool hasLandmarks() const;
+  int getNumLandmarks() const;
+  int getLandmarkActorId(int landmark) const;
+  const unsigned char *getLandmarkDistances(int landmark) const;
+
+/**
+ * Method: buildLandmarks
+ * ----------------------
+ * Picks up to numLandmarks well-connected actors, none of whom costarred
+ * with another, computes every actor's distance from each by breadth-first
+ * search over the compiled graph, and writes them all to the landmarks file
+ * within the specified directory.  Requires hasGraph().  Returns true if
+ * and only if the file was written without incident.
+ */
+
+  bool buildLandmarks(const std::string& directory, int numLandmarks) const;
+
+/**
+ * Methods: hasHub
+ *          getHubDistance
+ *          getHubParent
+ * ----------------------
+ * Expose the hub tables (as produced by buildHub) found alongside the graph.
+ * A hub table records, for every actor, the number of degrees separating it
+ * from the hub actor (kUnreachable if they aren't connected) and the actor
+ * and movie it was first reached through by a breadth-first search from the
+ * hub, so following parents from any actor traces a shortest path back to
+ * the hub without any search.  The hub is its own parent.  getHubDistance
+ * and getHubParent require hasHub(hubId), and getHubParent returns false
+ * for actors the hub doesn't reach.
+ */
+
+  bool hasHub(int hubId) const;
+  int getHubDistance(int hubId, int actorId) const;
+  bool getHubParent(int hubId, int actorId, int& parentId, int& movieId) const;
+
+/**
+ * Method: buildHub
+ * ----------------
+ * Runs a full breadth-first search from the specified actor over the
+ * compiled graph and writes the resulting hub table to its own file within
+ * the specified directory, so that hubs can be added or rebuilt one at a
+ * time.  Requires hasGraph().  Any number of threads may build different
+ * hubs at once.  Returns true if and only if the table was written without
+ * incident.
+ */
+
+  bool buildHub(const std::string& directory, int hubId) const;
+
+/**
+ * Predicate Method: hasLookupIndexes
+ * ----------------------------------
+ * Returns true if and only if up-to-date actordata.idx and moviedata.idx
+ * files (as produced by buildLookupIndexes) were found alongside the data
+ * files.  When they were, exact-name lookups (getCredits, getCast, the
+ * visitors, getActorOffset and getMovieOffset) hash the name and probe
+ * the index instead of binary searching the sorted offset tables.  An index
+ * that is missing or doesn't match its data file is ignored, and lookups
+ * fall back to binary search.
+ */
+
+  bool hasLookupIndexes() const;
+
+/**
+ * Method: buildLookupIndexes
+ * --------------------------
+ * Builds open-addressing hash tables mapping actor names and films to
+ * their record offsets and writes them to actordata.idx and moviedata.idx
+ * in the specified directory.  Returns true if and only if both files were
+ * written without incident.
+ */
+
+  bool buildLookupIndexes(const std::string& directory) const;
+
+/**
+ * Methods: prefixSearch
+ * ---------------------
+ * Find the actors/actresses (or films) whose names (or titles) begin with
+ * the specified prefix, and append up to limit of them to the supplied
+ * vector in sorted order, those only the delta knows about included.
+ * Return true if and only if at least one match was found.
+ *
+ * The first call builds, for actors or films respectively, an in-memory
+ * copy of the sorted offset table rearranged into Eytzinger (breadth-first)
+ * order, each offset stored beside the first eight bytes of its name packed
+ * into an integer.  Searches then walk the array top-down, so the first few
+ * levels stay cached, and most comparisons are settled by the inline prefix
+ * without touching the name itself.
+ */
+
+  bool prefixSearch(const std::string& prefix, size_t limit, std::vector<std::string>& players) const;
+  bool prefixSearch(const std::string& prefix, size_t limit, std::vector<film>& films) const;
+
+/**
+ * Method: prefault
+ * ----------------
+ * Touches every page of every file the imdb has mapped (the data files
+ * and, when present, the graph and lookup indexes) so that later queries
+ * never stall on a page fault.  Long-running clients like search's server
+ * mode call this once up front.  Returns the number of pages touched.
+ */
+
+  size_t prefault() const;
+
+/**
+ * Methods: getLoadStatistics
+ * --------------------------
+ * getLoadStatistics reports what the constructor's load policy cost.  Under
+ * kLoadInBackground, awaitBackgroundLoad waits for the prefaulting thread
+ * to finish (and is a no-op otherwise), after which getLoadStatistics
+ * includes what the thread cost as well.  Queries needn't wait for it.
+ */
+
+  const loadStatistics& getLoadStatistics() const;
+  void awaitBackgroundLoad();
+
 /**
  * Destructor: ~imdb
  * -----------------
@@ -80,23 +526,175 @@ class imdb {
  private:
   static const char *const kActorFileName;
   static const char *const kMovieFileName;
+  static const char *const kGraphFileName;
+  static const char *const kLandmarkFileName;
+  static const char *const kHubFilePrefix;
+  static const char *const kLookupIndexSuffix;
+  static const char *const kDeltaFileName;
   const void *actorFile;
   const void *movieFile;
-  std::vector<int> getRecordNodes(const void *file) const;
-  film getFilm(char *movieRecord) const;
+  const void *graphFile;
+  const int *actorIndex, *creditIds; // CSR arrays within graphFile,
+  const int *movieIndex, *castIds;   // all NULL unless hasGraph()
+  const int *movieYears;
+  const void *landmarkFile;
+  const int *landmarkIds;                  // within landmarkFile, and
+  const unsigned char *landmarkDistances;  // NULL unless hasLandmarks()
+  const void *actorLookup;
+  const void *movieLookup;
+  int lookupActor(const std::string& player) const;
+  int lookupMovie(const film& movie) const;
+
+  struct prefixEntry {
+    uint64_t prefix; // first eight bytes of the name, big-endian, NUL padded
+    int offset;
+  };
+
+  mutable std::vector<prefixEntry> actorPrefixes, moviePrefixes; // Eytzinger order, 1-based
+  mutable std::once_flag actorPrefixesBuilt, moviePrefixesBuilt;
+  const std::vector<prefixEntry>& getPrefixEntries(const void *file, std::vector<prefixEntry>& entries,
+                                                   std::once_flag& built) const;
+  template <typename Visitor>
+  void forEachPrefixMatch(const void *file, const std::vector<prefixEntry>& entries,
+                          const std::string& prefix, size_t limit, Visitor visit) const;
+  compressedTable actorTable, movieTable; // attached only if isCompressed()
+  const compressedTable& getTable(const void *file) const { return file == actorFile ? actorTable : movieTable; }
+  int getNumRecords(const void *file) const;
+  int getRecordOffset(const void *file, int id) const;
+  const char *readName(const void *file, int offset, std::string& scratch) const;
+  int readYear(int movieOffset) const;
+  template <typename Visitor>
+  void forEachListedOffset(const void *file, int offset, Visitor visit) const;
+  static int getYear(const char *movieRecord);
+  static const int *getActorPayload(const char *actorRecord, short& numMovies);
+  static const int *getMoviePayload(const char *movieRecord, short& numActors);
+  void loadGraph(const std::string& fileName);
+  void loadLandmarks(const std::string& fileName);
+  void loadHubs(const std::string& directory);
+  int getMovieId(const film& movie) const;
+  void loadDelta(const std::string& fileName);
+
+  struct deltaEdge {
+    int offset, id; // of the movie credited or the actor cast
+  };
+
+  std::unordered_map<int, std::vector<deltaEdge>> deltaCredits; // keyed by actor offset, and
+  std::unordered_map<int, std::vector<deltaEdge>> deltaCasts;   // by movie offset
+  std::vector<std::string> deltaPlayers;  // actors and movies only the delta has, whose offsets
+  std::vector<film> deltaMovies;          // count down from -2 and ids carry on from the data files'
+  std::map<std::string, int> deltaPlayerIndex; // sorted, for prefixSearch
+  std::map<film, int> deltaMovieIndex;
+  size_t numDeltaCredits;
+  void computeDistances(int source, std::vector<unsigned char>& distances, int *parents) const;
   
   // everything below here is complicated and needn't be touched.
   // you're free to investigate, but you're on your own.
   struct fileInfo {
     int fd;
     size_t fileSize;
+    int64_t inode;
+    int64_t modifiedTime; // in nanoseconds since the epoch
     const void *fileMap;
-  } actorInfo, movieInfo;
+  } actorInfo, movieInfo, graphInfo, landmarkInfo, actorLookupInfo, movieLookupInfo;
+  std::map<int, struct fileInfo> hubInfo; // hub actor id -> its mapped hub table
+  loadStatistics statistics;
+  std::thread backgroundLoader;
+  std::atomic<bool> stopBackgroundLoad;
   
-  static const void *acquireFileMap(const std::string& fileName, struct fileInfo& info);
+  void load(const std::string& directory);
+  void loadInBackground();
+  const void *acquireFileMap(const std::string& fileName, struct fileInfo& info);
   static void releaseFileMap(struct fileInfo& info);
+  static size_t prefaultFileMap(const struct fileInfo& info, size_t begin = 0, size_t end = SIZE_MAX,
+                                const std::atomic<bool> *stop = NULL);
+  const void *loadLookupIndex(const std::string& fileName, struct fileInfo& info,
+                              const struct fileInfo& dataInfo, int numRecords);
 
   imdb(const imdb& original) = delete;
   imdb& operator=(const imdb& rhs) = delete;
   imdb& operator=(const imdb& rhs) const = delete;
 };
+
+/**
+ * The visitor methods are templates so that each visitor is invoked
+ * directly (and can be inlined) instead of through a std::function.
+ */
+
+template <typename Visitor>
+void imdb::forEachListedOffset(const void *file, int offset, Visitor visit) const {
+  if (isCompressed()) {
+    idCursor cursor = getTable(file).getList(offset - 1);
+    int ids[compressedTable::kDecodeBatch];
+    for (size_t numIds; (numIds = compressedTable::decodeIds(cursor, ids)) > 0; ) {
+      for (size_t i = 0; i < numIds; i++) if (!visit(ids[i] + 1)) return;
+    }
+    return;
+  }
+
+  short numListed;
+  const char *record = (const char *) file + offset;
+  const int *payload = file == actorFile ? getActorPayload(record, numListed) : getMoviePayload(record, numListed);
+  for (short i = 0; i < numListed; i++) {
+    if (!visit(payload[i])) return;
+  }
+}
+
+template <typename Visitor>
+void imdb::forEachCredit(int actorOffset, Visitor visit) const {
+  std::string title;
+  bool more = true;
+  if (actorOffset >= 0) forEachListedOffset(actorFile, actorOffset, [&](int movieOffset) -> bool {
+    return more = visit(readName(movieFile, movieOffset, title), readYear(movieOffset), movieOffset);
+  });
+  auto delta = deltaCredits.find(actorOffset);
+  if (!more || delta == deltaCredits.end()) return;
+  for (const deltaEdge& edge: delta->second) {
+    if (!visit(readName(movieFile, edge.offset, title), readYear(edge.offset), edge.offset)) return;
+  }
+}
+
+template <typename Visitor>
+bool imdb::forEachCredit(const std::string& player, Visitor visit) const {
+  int actorOffset = getActorOffset(player);
+  if (actorOffset == -1) return false;
+  forEachCredit(actorOffset, visit);
+  return true;
+}
+
+template <typename Visitor>
+void imdb::forEachCastMember(int movieOffset, Visitor visit) const {
+  std::string player;
+  bool more = true;
+  if (movieOffset >= 0) forEachListedOffset(movieFile, movieOffset, [&](int actorOffset) -> bool {
+    return more = visit(readName(actorFile, actorOffset, player), actorOffset);
+  });
+  auto delta = deltaCasts.find(movieOffset);
+  if (!more || delta == deltaCasts.end()) return;
+  for (const deltaEdge& edge: delta->second) {
+    if (!visit(readName(actorFile, edge.offset, player), edge.offset)) return;
+  }
+}
+
+template <typename Visitor>
+bool imdb::forEachCastMember(const film& movie, Visitor visit) const {
+  int movieOffset = getMovieOffset(movie);
+  if (movieOffset == -1) return false;
+  forEachCastMember(movieOffset, visit);
+  return true;
+}
+
+template <typename Visitor>
+void imdb::forEachDeltaCreditId(int actorId, Visitor visit) const {
+  if (deltaCredits.empty()) return;
+  auto delta = deltaCredits.find(getRecordOffset(actorFile, actorId));
+  if (delta == deltaCredits.end()) return;
+  for (const deltaEdge& edge: delta->second) if (!visit(edge.id)) return;
+}
+
+template <typename Visitor>
+void imdb::forEachDeltaCastId(int movieId, Visitor visit) const {
+  if (deltaCasts.empty()) return;
+  auto delta = deltaCasts.find(getRecordOffset(movieFile, movieId));
+  if (delta == deltaCasts.end()) return;
+  for (const deltaEdge& edge: delta->second) if (!visit(edge.id)) return;
+}
@@ -0,0 +1,385 @@
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "pathfinder.h"
+using namespace std;
+
+static const int MAX_DEGREE = 6;
+
+/**
+ * Class: idset
+ * ------------
+ * Flat bitset over dense ids.  Bits are set with an atomic fetch_or, so any
+ * number of threads can insert concurrently, and insert reports whether the
+ * calling thread was the one to set the bit.
+ */
+class idset {
+ public:
+  idset(size_t numIds) : words((numIds + 63) / 64) {}
+  bool insert(int id) {
+    uint64_t bit = uint64_t(1) << (id % 64);
+    return (words[id / 64].fetch_or(bit, memory_order_relaxed) & bit) == 0;
+  }
+  bool contains(int id) const {
+    uint64_t bit = uint64_t(1) << (id % 64);
+    return (words[id / 64].load(memory_order_relaxed) & bit) != 0;
+  }
+ private:
+  vector<atomic<uint64_t>> words;
+};
+
+/**
+ * Class: lockedSet
+ * ----------------
+ * unordered_set guarded by a mutex so that it offers the same insert and
+ * contains methods as idset for keys that aren't dense ids.  The size hint
+ * is accepted only for symmetry with idset.
+ */
+template <typename T, typename Hash = hash<T>>
+class lockedSet {
+ public:
+  lockedSet(size_t sizeHint) {}
+  bool insert(const T& key) {
+    lock_guard<mutex> lg(m);
+    return keys.insert(key).second;
+  }
+  bool contains(const T& key) const {
+    lock_guard<mutex> lg(m);
+    return keys.find(key) != keys.end();
+  }
+ private:
+  unordered_set<T, Hash> keys;
+  mutable mutex m;
+};
+
+/**
+ * Class: recordView
+ * -----------------
+ * Presents the imdb as a graph whose actors and movies are identified by the
+ * offsets of their records, so neighbors are read straight out of each record
+ * through the imdb's visitor methods without a single name lookup.  The search
+ * below is written against this interface so that it can run unchanged over the
+ * compiled graph (see graphView) when one is available.  Visitor callbacks
+ * return false to stop the enumeration early.  Any number of threads may
+ * use the same view at once, since the imdb itself is read-only.  Credits
+ * outside the view's range of years are skipped, so neither they nor their
+ * casts are ever expanded.  The visitors take care of any delta.
+ */
+class recordView {
+ public:
+  typedef int actor;
+  typedef int movie;
+  typedef lockedSet<int> actorSet;
+  typedef lockedSet<int> movieSet;
+
+  recordView(const imdb& db, const yearRange& years) : db(db), years(years) {}
+
+  template <typename Visitor>
+  void forEachCredit(int player, Visitor visit) const {
+    const yearRange& years = this->years;
+    db.forEachCredit(player, [&visit, &years](const char *title, int year, int movie) -> bool {
+      return !years.contains(year) || visit(movie);
+    });
+  }
+
+  template <typename Visitor>
+  void forEachCastMember(int movie, Visitor visit) const {
+    db.forEachCastMember(movie, [&visit](const char *name, int player) -> bool {
+      return visit(player);
+    });
+  }
+
+  string getName(int player) const { return db.getActorNameAt(player); }
+  film getFilm(int movie) const { return db.getMovieAt(movie); }
+
+ private:
+  const imdb& db;
+  yearRange years;
+};
+
+/**
+ * Class: graphView
+ * ----------------
+ * Presents the compiled graph through the same interface as recordView, except
+ * that actors and movies are dense integer ids, neighbors come straight out
+ * of the CSR arrays, and the visited sets are flat atomic bitsets.  Credits
+ * are sorted by year, so the range of years is applied by binary search.
+ * Whatever the delta adds (actors and movies only it knows about included)
+ * is visited after the arrays, and filtered by year one credit at a time.
+ */
+class graphView {
+ public:
+  typedef int actor;
+  typedef int movie;
+
+  typedef idset actorSet;
+  typedef idset movieSet;
+
+  graphView(const imdb& db, const yearRange& years) : db(db), years(years) {}
+
+  template <typename Visitor>
+  void forEachCredit(int player, Visitor visit) const {
+    for (int movie: db.getCreditIds(player, years.from, years.to)) if (!visit(movie)) return;
+    const imdb& db = this->db;
+    const yearRange& years = this->years;
+    db.forEachDeltaCreditId(player, [&](int movie) -> bool {
+      return !years.contains(db.getMovieYear(movie)) || visit(movie);
+    });
+  }
+
+  template <typename Visitor>
+  void forEachCastMember(int movie, Visitor visit) const {
+    for (int player: db.getCastIds(movie)) if (!visit(player)) return;
+    db.forEachDeltaCastId(movie, visit);
+  }
+
+  string getName(int player) const { return db.getActorName(player); }
+  film getFilm(int movie) const { return db.getMovie(movie); }
+
+ private:
+  const imdb& db;
+  yearRange years;
+};
+
+/**
+ * Class: landmarkBound
+ * --------------------
+ * Lower bound on the degrees separating any actor from one fixed actor, by way
+ * of the landmarks and the triangle inequality: no actor can be fewer than
+ * |d(L, actor) - d(L, fixed)| degrees from the fixed one, whatever the landmark
+ * L.  Should some landmark reach exactly one of the two, they aren't connected
+ * at all, and the bound is kDisconnected.  Since adjacent actors are within one
+ * degree of every landmark, bounds of adjacent actors differ by at most one.
+ * Actors are dense ids, so bounds are only available over the compiled graph.
+ */
+class landmarkBound {
+ public:
+  static const int kDisconnected = 1 << 20;
+
+  landmarkBound(const imdb& db, int fixed) {
+    for (int l = 0; l < db.getNumLandmarks(); l++) {
+      distances.push_back(db.getLandmarkDistances(l));
+      fixedDistances.push_back(distances.back()[fixed]);
+    }
+  }
+
+  int operator()(int player) const {
+    int bound = 0;
+    for (size_t l = 0; l < distances.size(); l++) {
+      int distance = distances[l][player];
+      if (distance == imdb::kUnreachable || fixedDistances[l] == imdb::kUnreachable) {
+        if (distance != fixedDistances[l]) return kDisconnected;
+      } else {
+        bound = max(bound, abs(distance - fixedDistances[l]));
+      }
+    }
+    return bound;
+  }
+
+ private:
+  vector<const unsigned char *> distances;
+  vector<int> fixedDistances;
+};
+
+/**
+ * Struct: searchSide
+ * ------------------
+ * One half of a bidirectional search: everything reached so far from one
+ * endpoint, each reached actor mapped to the actor and movie it was reached
+ * through, plus the actors discovered most recently.  The root maps to itself.
+ * When toGoal is supplied, it bounds how far each actor is from the other
+ * endpoint, and actors that can't be on a connection of at most MAX_DEGREE
+ * degrees are passed over rather than visited.
+ */
+template <typename View>
+struct searchSide {
+  typedef typename View::actor actor;
+  typedef typename View::movie movie;
+
+  unordered_map<actor, pair<actor, movie>> parents;
+  typename View::actorSet visitedActors;
+  typename View::movieSet visitedMovies;
+  vector<actor> frontier;
+  int depth;
+  const landmarkBound *toGoal;
+
+  searchSide(const imdb& db, const actor& root, const landmarkBound *toGoal = NULL) :
+    visitedActors(db.getNumActors() + db.getNumDeltaActors()),
+    visitedMovies(db.getNumMovies() + db.getNumDeltaMovies()), frontier(1, root), depth(0),
+    toGoal(toGoal) {
+    parents[root] = pair<actor, movie>(root, movie());
+    visitedActors.insert(root);
+  }
+
+  /**
+   * Expands every actor in the frontier by one degree, using the specified
+   * number of threads.  Threads pull frontier actors off a shared index and
+   * claim newly reached movies and actors in the visited sets, so each is
+   * expanded exactly once; every thread logs what it reached privately, and
+   * the logs are merged into parents once all threads are joined.  Actors
+   * pruned by toGoal aren't claimed, but since the other side only ever
+   * reaches actors within MAX_DEGREE of this root, none of them is the meeting
+   * point, and the search still finds a shortest connection.  Returns
+   * true as soon as an actor already reached by the other side turns up, in
+   * which case that actor is surfaced via meet and the expansion is abandoned.
+   */
+  bool expand(const View& view, const searchSide& other, actor& meet, size_t numThreads) {
+    struct discovery {
+      actor player;
+      actor parent;
+      movie via;
+    };
+
+    vector<vector<discovery>> discoveries(numThreads);
+    atomic<size_t> nextIndex(0);
+    atomic<bool> met(false);
+    mutex meetLock;
+    auto expandSome = [&](size_t threadID) {
+      vector<discovery>& found = discoveries[threadID];
+      for (size_t i = nextIndex++; i < frontier.size() && !met; i = nextIndex++) {
+        const actor& player = frontier[i];
+        view.forEachCredit(player, [&](const movie& m) -> bool {
+          if (!visitedMovies.insert(m)) return !met;
+          view.forEachCastMember(m, [&](const actor& costar) -> bool {
+            if (toGoal != NULL && (visitedActors.contains(costar) ||
+                                   depth + 1 + (*toGoal)(costar) > MAX_DEGREE)) return true;
+            if (!visitedActors.insert(costar)) return true;
+            found.push_back(discovery{costar, player, m});
+            if (!other.visitedActors.contains(costar)) return true;
+            lock_guard<mutex> lg(meetLock);
+            if (!met) meet = costar;
+            met = true;
+            return false;
+          });
+          return !met;
+        });
+      }
+    };
+
+    if (numThreads == 1) {
+      expandSome(0);
+    } else {
+      vector<thread> threads;
+      for (size_t threadID = 0; threadID < numThreads; threadID++)
+        threads.push_back(thread(expandSome, threadID));
+      for (thread& t: threads) t.join();
+    }
+
+    vector<actor> next;
+    for (const vector<discovery>& found: discoveries) {
+      for (const discovery& d: found) {
+        parents[d.player] = pair<actor, movie>(d.parent, d.via);
+        next.push_back(d.player);
+      }
+    }
+    if (met) return true;
+    frontier.swap(next);
+    depth++;
+    return false;
+  }
+};
+
+/**
+ * Stitches the two halves of a bidirectional search together: the forward
+ * half is traced back from the meeting point to the start and reversed, and
+ * the backward half is then followed from the meeting point to the end.
+ */
+template <typename View>
+static path backTrace(const View& view, const searchSide<View>& forward, const searchSide<View>& backward,
+                      const typename View::actor& meet) {
+  typedef typename View::actor actor;
+  typedef typename View::movie movie;
+  path p(view.getName(meet));
+  for (actor player = meet; forward.parents.at(player).first != player; ) {
+    const pair<actor, movie>& pa = forward.parents.at(player);
+    p.addConnection(view.getFilm(pa.second), view.getName(pa.first));
+    player = pa.first;
+  }
+  p.reverse();
+  for (actor player = meet; backward.parents.at(player).first != player; ) {
+    const pair<actor, movie>& pa = backward.parents.at(player);
+    p.addConnection(view.getFilm(pa.second), view.getName(pa.first));
+    player = pa.first;
+  }
+  return p;
+}
+
+/**
+ * Breadth-first search from both endpoints at once, always growing whichever
+ * frontier is currently smaller.  The first actor reached by both sides lies on
+ * a shortest path, since all shorter connections would have been found while
+ * expanding earlier levels.  The two depths together never exceed MAX_DEGREE.
+ * Each level is expanded by numThreads threads.  Landmark bounds, if supplied,
+ * prune both sides down to actors that could lie on a short enough connection.
+ * (Distances over the films in a range of years are never shorter than those
+ * over every film, so the bounds hold whatever the range.)
+ */
+template <typename View>
+static path findPath(const imdb& db, const typename View::actor& startPlayer,
+                     const typename View::actor& endPlayer, size_t numThreads, const yearRange& years,
+                     const landmarkBound *toEnd = NULL, const landmarkBound *toStart = NULL) {
+  View view(db, years);
+  searchSide<View> forward(db, startPlayer, toEnd), backward(db, endPlayer, toStart);
+  while (!forward.frontier.empty() && !backward.frontier.empty() &&
+         forward.depth + backward.depth < MAX_DEGREE) {
+    bool forwardIsSmaller = forward.frontier.size() <= backward.frontier.size();
+    searchSide<View>& side = forwardIsSmaller ? forward : backward;
+    const searchSide<View>& other = forwardIsSmaller ? backward : forward;
+    typename View::actor meet;
+    if (side.expand(view, other, meet, numThreads)) return backTrace(view, forward, backward, meet);
+  }
+  return path(view.getName(startPlayer));
+}
+
+/**
+ * Reads the path between the specified actor and a hub straight out of the
+ * hub's table, by following parents from the actor back to the hub.  The path
+ * runs from the hub to the actor when hubFirst is true, and the other way
+ * around otherwise.  Actors more than MAX_DEGREE from the hub aren't followed.
+ */
+static path readHubPath(const imdb& db, int hub, int player, bool hubFirst) {
+  path p(db.getActorName(player));
+  int distance = db.getHubDistance(hub, player);
+  if (distance == imdb::kUnreachable || distance > MAX_DEGREE) return p;
+  for (int parent, movie; player != hub; player = parent) {
+    db.getHubParent(hub, player, parent, movie);
+    p.addConnection(db.getMovie(movie), db.getActorName(parent));
+  }
+  if (hubFirst) p.reverse();
+  return p;
+}
+
+/**
+ * Searches the compiled graph when there is one, and the records themselves
+ * otherwise.  Queries involving a hub are answered from its table instead,
+ * unless the search is limited to a range of years the table knows nothing
+ * about.  Given landmarks, pairs the bounds show to be unconnected (or more
+ * than MAX_DEGREE apart) are turned away without any search at all.  Hub
+ * tables and landmarks describe the data files alone, and the credits a
+ * delta adds can bring actors closer together, so neither is used while
+ * there's a delta.
+ */
+path findPath(const imdb& db, const string& startPlayer, const string& endPlayer, size_t numThreads,
+              const yearRange& years) {
+  if (!db.hasGraph()) {
+    int startActor = db.getActorOffset(startPlayer);
+    int endActor = db.getActorOffset(endPlayer);
+    if (startActor == -1 || endActor == -1) return path(startPlayer);
+    return findPath<recordView>(db, startActor, endActor, numThreads, years);
+  }
+
+  int startActor = db.getActorId(startPlayer);
+  int endActor = db.getActorId(endPlayer);
+  if (startActor == -1 || endActor == -1) return path(startPlayer);
+  if (db.hasDelta()) return findPath<graphView>(db, startActor, endActor, numThreads, years);
+  if (!years.isRestricted() && db.hasHub(startActor)) return readHubPath(db, startActor, endActor, true);
+  if (!years.isRestricted() && db.hasHub(endActor)) return readHubPath(db, endActor, startActor, false);
+  if (!db.hasLandmarks()) return findPath<graphView>(db, startActor, endActor, numThreads, years);
+  landmarkBound toEnd(db, endActor), toStart(db, startActor);
+  if (toEnd(startActor) > MAX_DEGREE) return path(startPlayer);
+  return findPath<graphView>(db, startActor, endActor, numThreads, years, &toEnd, &toStart);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <climits>
+#include "imdb.h"
+#include "path.h"
+
+/**
+ * Struct: yearRange
+ * -----------------
+ * Inclusive window of years.  Searches only follow films made within it, so
+ * the paths they find use nothing else.
+ */
+struct yearRange {
+  int from;
+  int to;
+
+  bool isRestricted() const { return from != INT_MIN || to != INT_MAX; }
+  bool contains(int year) const { return year >= from && year <= to; }
+};
+
+const yearRange kAllYears = { INT_MIN, INT_MAX };
+
+/**
+ * Function: findPath
+ * ------------------
+ * Returns a shortest path (of at most six degrees) connecting the two
+ * specified actors, using only films within the specified range of years,
+ * or a path of length 0 if there isn't one.  The compiled graph is searched
+ * when there is one, and the records themselves otherwise; hub tables and
+ * landmarks are used whenever the imdb has them.  Each level of the search
+ * is expanded by numThreads threads, and any number of threads may search
+ * the same imdb at once.
+ */
+path findPath(const imdb& db, const std::string& startPlayer, const std::string& endPlayer, size_t numThreads,
+              const yearRange& years);
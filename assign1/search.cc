@@ -1,10 +1,25 @@
 #include <vector>
 #include <iostream>
 #include <string>
-#include <queue>
-#include <unordered_set>
 #include <unordered_map>
-#include "path.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <list>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <unistd.h>
+#include <getopt.h>
+#include "socket++/sockunix.h"
+#include "pathfinder.h"
 #include "string.h"
 #include "imdb.h"
 using namespace std;
@@ -12,100 +27,380 @@ using namespace std;
 static const int kWrongArgumentCount = 1;
 static const int kSourceTargetSame = 2;
 static const int kDatabaseNotFound = 3;
-static const int MAX_DEGREE = 6;
+static const int kBadThreadCount = 4;
+static const int kQueryFileNotFound = 5;
+static const int kSocketError = 6;
+static bool sanity(const imdb& db, const string& startPlayer, const string& endPlayer) {
+  vector<film> credits;
+  if (!db.getCredits(startPlayer, credits) || credits.size() == 0) return false;
+  credits.clear();
+  if (!db.getCredits(endPlayer, credits) || credits.size() == 0) return false;
+  return true;
+}
 
+static const string kNoPathFound = "No path between those two people could be found.";
+static const string kSameSourceAndTarget = "Ensure that source and target actors are different!";
+
+/**
+ * Function: answerQuery
+ * ---------------------
+ * Returns exactly what search prints for the specified pair of actors:
+ * either the path connecting them or the message saying there isn't one.
+ */
+static string answerQuery(const imdb& db, const string& startPlayer, const string& endPlayer, size_t numThreads,
+                          const yearRange& years) {
+  if (!sanity(db, startPlayer, endPlayer)) return kNoPathFound + "\n";
+  path p = findPath(db, startPlayer, endPlayer, numThreads, years);
+  if (p.getLength() == 0) return kNoPathFound + "\n";
+  ostringstream os;
+  os << p;
+  return os.str();
+}
+
+/**
+ * Function: runBatch
+ * ------------------
+ * Answers every source<TAB>target query read from the specified stream
+ * against the one (already warm) imdb.  numJobs worker threads claim queries
+ * in order off a shared counter and post their answers; meanwhile this thread
+ * prints the answers strictly in input order, each preceded by a line naming
+ * the query and how long it took to answer, as soon as the answer is posted.
+ */
+static void runBatch(const imdb& db, istream& in, size_t numJobs, size_t numThreads, const yearRange& years) {
+  vector<pair<string, string>> queries;
+  vector<bool> malformed;
+  string line;
+  while (getline(in, line)) {
+    size_t tab = line.find('\t');
+    malformed.push_back(tab == string::npos);
+    if (tab == string::npos) tab = line.size();
+    queries.push_back(make_pair(line.substr(0, tab), line.substr(min(tab + 1, line.size()))));
+  }
+
+  size_t numQueries = queries.size();
+  vector<string> answers(numQueries);
+  vector<double> elapsed(numQueries);
+  vector<bool> answered(numQueries, false);
+  mutex m;
+  condition_variable cv;
+  atomic<size_t> nextQuery(0);
+  vector<thread> workers;
+  for (size_t j = 0; j < numJobs; j++) {
+    workers.push_back(thread([&]() {
+      for (size_t i = nextQuery++; i < numQueries; i = nextQuery++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        string answer;
+        if (malformed[i]) answer = "Queries must be of the form <source-actor><TAB><target-actor>.\n";
+        else if (queries[i].first == queries[i].second) answer = kSameSourceAndTarget + "\n";
+        else answer = answerQuery(db, queries[i].first, queries[i].second, numThreads, years);
+        chrono::duration<double, milli> duration = chrono::steady_clock::now() - start;
+        lock_guard<mutex> lg(m);
+        answers[i].swap(answer);
+        elapsed[i] = duration.count();
+        answered[i] = true;
+        cv.notify_all();
+      }
+    }));
+  }
 
-static path backTrace(const unordered_map<string, pair<string, film>>& parents, const string& startPlayer, const string& endPlayer) {
-  path p(endPlayer);
-  while (p.getLastPlayer() != startPlayer) {
-    string lastPlayer = p.getLastPlayer();
-    pair<string, film> pa = parents.at(lastPlayer);
-    p.addConnection(pa.second, pa.first);
+  for (size_t i = 0; i < numQueries; i++) {
+    unique_lock<mutex> ul(m);
+    cv.wait(ul, [&]() { return answered[i]; });
+    string answer;
+    answer.swap(answers[i]);
+    double ms = elapsed[i];
+    ul.unlock();
+    cout << "== " << queries[i].first << " -> " << queries[i].second
+         << " (" << fixed << setprecision(3) << ms << " ms)" << endl << answer;
   }
-  p.reverse();
-  return p;
+  for (thread& t: workers) t.join();
 }
 
-static path findPath(const imdb& db, const string& startPlayer, const string& endPlayer) {
-  struct filmHash {
-    size_t operator()(film f) const {
-      return hash<string>()(f.title) ^ hash<int>()(f.year);
+/**
+ * Class: pathCache
+ * ----------------
+ * Thread-safe LRU map from source<TAB>target queries to the answers
+ * answerQuery produced for them, so that the server answers repeated
+ * queries without searching again.  Once capacity answers are cached,
+ * inserting another evicts the one least recently inserted or looked up.
+ */
+class pathCache {
+ public:
+  pathCache(size_t capacity) : capacity(capacity) {}
+
+  bool lookup(const string& query, string& answer) {
+    lock_guard<mutex> lg(m);
+    auto found = entries.find(query);
+    if (found == entries.end()) return false;
+    recency.splice(recency.begin(), recency, found->second);
+    answer = found->second->second;
+    return true;
+  }
+
+  void insert(const string& query, const string& answer) {
+    if (capacity == 0) return;
+    lock_guard<mutex> lg(m);
+    auto found = entries.find(query);
+    if (found != entries.end()) {
+      recency.erase(found->second);
+      entries.erase(found);
     }
-  };
-  unordered_set<string> visitedActors;
-  unordered_set<film, filmHash> visitedMovies;
-  unordered_map<string, pair<string, film>> parents;
-  queue<pair<string,int>> q;
-  q.push(pair<string, int>(startPlayer, 0));
-  visitedActors.insert(startPlayer);
-  while (!q.empty()) {
-    pair<string, int> pa = q.front();
-    q.pop();
-    string player = pa.first;
-    int degree = pa.second;
-    vector<film> credits;
-    db.getCredits(player, credits);
-    for (film f: credits) {
-      if (visitedMovies.find(f) == visitedMovies.end()) {
-        visitedMovies.insert(f);
-        vector<string> cast;
-        db.getCast(f, cast);
-        for (string actor: cast) {
-          if (visitedActors.find(actor) == visitedActors.end()) {
-            parents[actor] = pair<string, film>(player, f);
-            if (actor == endPlayer) return backTrace(parents, startPlayer, endPlayer);
-            if (degree + 1 < MAX_DEGREE) {
-              q.push(pair<string, int>(actor, degree + 1));
-            }
-            visitedActors.insert(actor);
-          }
+    recency.push_front(make_pair(query, answer));
+    entries[query] = recency.begin();
+    if (entries.size() > capacity) {
+      entries.erase(recency.back().first);
+      recency.pop_back();
+    }
+  }
+
+ private:
+  size_t capacity;
+  list<pair<string, string>> recency;
+  unordered_map<string, list<pair<string, string>>::iterator> entries;
+  mutex m;
+};
+
+/**
+ * Class: connectionbuf
+ * --------------------
+ * A sockunixbuf that can drop whatever output it's still buffering.  That
+ * needs to happen once a client hangs up mid-answer, since sockbuf's
+ * destructor otherwise tries to flush the leftovers and throws from it.
+ */
+class connectionbuf : public sockunixbuf {
+ public:
+  connectionbuf(const sockbuf::sockdesc& client) : sockunixbuf(client) {}
+  void discard() { setp(pbase(), epptr()); }
+};
+
+/**
+ * Function: serveClient
+ * ---------------------
+ * Answers source<TAB>target queries read off the specified connection
+ * until the client closes it.  Each answer is exactly what search would
+ * print for the query, followed by an empty line marking its end.
+ */
+static void serveClient(const imdb& db, const sockbuf::sockdesc& client, pathCache& cache, size_t numThreads,
+                        const yearRange& years) {
+  connectionbuf sb(client);
+  iosockstream ss(&sb);
+  string query;
+  while (getline(ss, query)) {
+    size_t tab = query.find('\t');
+    string answer;
+    if (tab == string::npos) {
+      answer = "Queries must be of the form <source-actor><TAB><target-actor>.\n";
+    } else if (query.compare(0, tab, query, tab + 1, string::npos) == 0) {
+      answer = kSameSourceAndTarget + "\n";
+    } else if (!cache.lookup(query, answer)) {
+      answer = answerQuery(db, query.substr(0, tab), query.substr(tab + 1), numThreads, years);
+      cache.insert(query, answer);
+    }
+    ss << answer << endl;
+  }
+  if (ss.bad()) sb.discard();
+}
+
+/**
+ * Function: runServer
+ * -------------------
+ * Listens on a Unix domain socket at the specified path (replacing any
+ * stale socket file there) and serves connections on numJobs threads, each
+ * of which accepts a connection, answers it until the client hangs up, and
+ * goes back for another.  Every connection shares the one imdb (whose
+ * mappings stay resident for the life of the server) and the one cache of
+ * recent answers.  Never returns.
+ */
+static void runServer(const imdb& db, const string& socketPath, size_t numJobs, size_t numThreads,
+                      size_t cacheCapacity, const yearRange& years) {
+  signal(SIGPIPE, SIG_IGN);
+  sockunixbuf server(sockbuf::sock_stream);
+  unlink(socketPath.c_str());
+  server.bind(socketPath.c_str());
+  server.listen();
+  cout << "Serving path queries on " << socketPath << "." << endl;
+
+  pathCache cache(cacheCapacity);
+  vector<thread> workers;
+  for (size_t j = 0; j < numJobs; j++) {
+    workers.push_back(thread([&]() {
+      while (true) {
+        try {
+          sockbuf::sockdesc client = server.accept();
+          serveClient(db, client, cache, numThreads, years);
+        } catch (const sockerr& e) {
+          // a failed accept only costs that one connection
         }
       }
-    }
+    }));
   }
-  return path(startPlayer);
+  for (thread& t: workers) t.join();
 }
 
-static bool sanity(const imdb& db, const string& startPlayer, const string& endPlayer) {
-  vector<film> credits;
-  if (!db.getCredits(startPlayer, credits) || credits.size() == 0) return false;
-  credits.clear();
-  if (!db.getCredits(endPlayer, credits) || credits.size() == 0) return false;
+/**
+ * Function: runClient
+ * -------------------
+ * Sends one query to the server listening at the specified path and
+ * prints its answer, just as search would have printed it.
+ */
+static void runClient(const string& socketPath, const string& startPlayer, const string& endPlayer) {
+  iosockunix ss(sockbuf::sock_stream);
+  ss->connect(socketPath.c_str());
+  ss << startPlayer << '\t' << endPlayer << endl;
+  string line;
+  while (getline(ss, line) && !line.empty()) cout << line << endl;
+}
+
+/**
+ * Parses a --from, --to, or --cache value, which must be a whole (decimal)
+ * integer between min and max inclusive.
+ */
+static bool parseInteger(const char *arg, long min, long max, int& result) {
+  char *end;
+  errno = 0;
+  long value = strtol(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0' || errno == ERANGE || value < min || value > max) return false;
+  result = value;
   return true;
 }
 
+static void printUsage(const char *executable) {
+  cerr << "Usage: " << executable << " [--threads <n>] [--from <year>] [--to <year>] <source-actor> <target-actor>" << endl;
+  cerr << "       " << executable << " --batch [--jobs <n>] [--threads <n>] [--from <year>] [--to <year>] [<query-file>]" << endl;
+  cerr << "       " << executable << " --serve <socket> [--jobs <n>] [--threads <n>] [--cache <n>] [--prefault] [--load <policy>] [--from <year>] [--to <year>]" << endl;
+  cerr << "       " << executable << " --connect <socket> <source-actor> <target-actor>" << endl;
+}
+
 int main(int argc, char *argv[]) {
-  if (argc != 3) {
-    cerr << "Usage: " << argv[0] << " <source-actor> <target-actor>" << endl;
+  struct option options[] = {
+    {"threads", required_argument, NULL, 't'},
+    {"batch", no_argument, NULL, 'b'},
+    {"jobs", required_argument, NULL, 'j'},
+    {"serve", required_argument, NULL, 's'},
+    {"connect", required_argument, NULL, 'c'},
+    {"cache", required_argument, NULL, 'C'},
+    {"prefault", no_argument, NULL, 'p'},
+    {"load", required_argument, NULL, 'l'},
+    {"from", required_argument, NULL, 'f'},
+    {"to", required_argument, NULL, 'T'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t numThreads = 1;
+  size_t numJobs = max(thread::hardware_concurrency(), 1u);
+  bool batch = false;
+  string servePath, connectPath;
+  size_t cacheCapacity = 1024;
+  bool prefault = false;
+  imdb::loadPolicy policy = imdb::kLoadLazily;
+  yearRange years = kAllYears;
+  while (true) {
+    int ch = getopt_long(argc, argv, "t:bj:s:c:C:pl:f:T:", options, NULL);
+    if (ch == -1) break;
+    switch (ch) {
+    case 't':
+    case 'j':
+      if (atoi(optarg) <= 0) {
+        cerr << "The number of threads and jobs must be positive integers." << endl;
+        return kBadThreadCount;
+      }
+      (ch == 't' ? numThreads : numJobs) = atoi(optarg);
+      break;
+    case 'b':
+      batch = true;
+      break;
+    case 's':
+      servePath = optarg;
+      break;
+    case 'c':
+      connectPath = optarg;
+      break;
+    case 'C': {
+      int capacity;
+      if (!parseInteger(optarg, 0, INT_MAX, capacity)) {
+        cerr << "The cache capacity must be a nonnegative integer." << endl;
+        return kWrongArgumentCount;
+      }
+      cacheCapacity = capacity;
+      break;
+    }
+    case 'p':
+      prefault = true;
+      break;
+    case 'l':
+      if (!imdb::parseLoadPolicy(optarg, policy)) {
+        printUsage(argv[0]);
+        return kWrongArgumentCount;
+      }
+      break;
+    case 'f':
+    case 'T':
+      if (!parseInteger(optarg, INT_MIN, INT_MAX, ch == 'f' ? years.from : years.to)) {
+        printUsage(argv[0]);
+        return kWrongArgumentCount;
+      }
+      break;
+    default:
+      printUsage(argv[0]);
+      return kWrongArgumentCount;
+    }
+  }
+
+  bool serve = !servePath.empty();
+  int numArgs = argc - optind;
+  if ((batch && serve) || (!connectPath.empty() && (batch || serve || years.isRestricted())) ||
+      years.from > years.to ||
+      (batch ? numArgs > 1 : serve ? numArgs != 0 : numArgs != 2)) {
+    printUsage(argv[0]);
     return kWrongArgumentCount;
   }
 
-  if (strcmp(argv[1], argv[2]) == 0) {
-    cerr << "Ensure that source and target actors are different!" << endl;
+  if (!batch && !serve && strcmp(argv[optind], argv[optind + 1]) == 0) {
+    cerr << kSameSourceAndTarget << endl;
     return kSourceTargetSame;
   }
 
-  imdb db(kIMDBDataDirectory);
+  if (!connectPath.empty()) {
+    try {
+      runClient(connectPath, argv[optind], argv[optind + 1]);
+    } catch (const sockerr& e) {
+      cerr << "Failed to query the server at " << connectPath << ": " << e.errstr() << endl;
+      return kSocketError;
+    }
+    return 0;
+  }
+
+  imdb db(kIMDBDataDirectory, policy);
   if (!db.good()) {
     cerr << "Failed to properly initialize the imdb database." << endl;
     cerr << "Please check to make sure the source files exist and that you have permission to read them." << endl;
     return kDatabaseNotFound;
   }
 
-  string startPlayer = argv[1];
-  string endPlayer = argv[2];
-
-  string msgNoPathFound = "No path between those two people could be found.";
-  if (!sanity(db, startPlayer, endPlayer)) {
-    cout << msgNoPathFound << endl;
-  } else {
-    path p = findPath(db, startPlayer, endPlayer);
-    if (p.getLength() == 0) {
-      cout << msgNoPathFound << endl;
-    } else {
-      cout << p;
+  if (serve) {
+    if (prefault) db.prefault();
+    try {
+      runServer(db, servePath, numJobs, numThreads, cacheCapacity, years);
+    } catch (const sockerr& e) {
+      cerr << "Failed to serve on " << servePath << ": " << e.errstr() << endl;
+      return kSocketError;
+    }
+  }
+
+  if (batch) {
+    if (numArgs == 0) {
+      runBatch(db, cin, numJobs, numThreads, years);
+      return 0;
+    }
+    ifstream queries(argv[optind]);
+    if (!queries) {
+      cerr << "Failed to open the query file " << argv[optind] << "." << endl;
+      return kQueryFileNotFound;
     }
+    runBatch(db, queries, numJobs, numThreads, years);
+    return 0;
   }
 
+  cout << answerQuery(db, argv[optind], argv[optind + 1], numThreads, years);
   return 0;
 }
@@ -0,0 +1,34 @@
+#!/bin/bash
+
+# Builds databases from credits files whose last line has no newline, one of
+# them exactly 262144 bytes long so that the text fills its last page, and
+# checks that imdb-build neither crashes nor drops that last credit.
+
+dir=$(mktemp -d)
+trap "rm -rf $dir" EXIT
+status=0
+
+for size in 1000 262144; do
+  echo "############ $size bytes, no final newline ############"
+  credits=$dir/credits-$size.tsv
+  awk -v lines=$(((size - 64) / 30)) 'BEGIN {
+    for (i = 0; i < lines; i++) printf "Actor %06d\tFilm %06d\t%d\n", i, int(i / 3), 1950 + int(i / 3) % 50
+  }' > $credits
+  tail=$(printf '\tLast Film\t2000')
+  nameLength=$((size - $(stat -c %s $credits) - ${#tail}))
+  printf 'Last Actor %s%s' "$(head -c $((nameLength - 11)) /dev/zero | tr '\0' 'x')" "$tail" >> $credits
+  expected=$(grep -c '' $credits)
+
+  mkdir -p $dir/db-$size
+  output=$(./imdb-build $credits $dir/db-$size)
+  result=$?
+  echo "$output"
+  if [ $result -ne 0 ]; then
+    echo "imdb-build exited with status $result"
+    status=1
+  elif ! echo "$output" | grep -q " and $expected credits "; then
+    echo "expected $expected credits"
+    status=1
+  fi
+done
+exit $status
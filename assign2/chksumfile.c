@@ -13,6 +13,14 @@
 #include "chksumfile.h"
 #include <openssl/sha.h>
 
+static int chksumfile_update(const void *bytes, int len, void *shactx) {
+  return SHA1_Update(shactx, bytes, len) ? 0 : -1;
+}
+
+/**
+ * file_readruns hashes a mapped image's blocks straight out of the mapping,
+ * a run of neighbors on disk at a time, and reads anything else in chunks.
+ */
 int chksumfile_byinumber(struct unixfilesystem *fs, int inumber, void *chksum) {
   SHA_CTX shactx;
   if (!SHA1_Init(&shactx)) {
@@ -32,17 +40,8 @@ int chksumfile_byinumber(struct unixfilesystem *fs, int inumber, void *chksum) {
   }
 
   int size = inode_getsize(&in);
-  for (int offset = 0; offset < size; offset += DISKIMG_SECTOR_SIZE) {
-    char buf[DISKIMG_SECTOR_SIZE];
-    int bno = offset/DISKIMG_SECTOR_SIZE;
-
-    int bytesMoved = file_getblock(fs, inumber, bno, buf);
-    if (bytesMoved < 0)
-      return -1;
-
-    if (!SHA1_Update(&shactx, buf, bytesMoved))
-      return -1;
-  }
+  if (file_readruns(fs, inumber, 0, size, chksumfile_update, &shactx) != size)
+    return -1;
 
   if (!SHA1_Final(chksum, &shactx))
     return -1;
@@ -3,8 +3,208 @@
 #include "diskimg.h"
 #include "file.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+
+/**
+ * The dentry cache holds an index of each directory looked up recently: its
+ * entries, read with a single file_read, and, for directories with at least
+ * DIRINDEX_HASH_MIN entries, hash buckets over their names, built the first
+ * time the directory is searched.  Smaller directories are just scanned.
+ * The indexes are chained into buckets by directory inumber and kept on a
+ * list, most recently used first, and the least recently used are dropped
+ * once they hold more than DENTRY_CACHE_ENTRIES entries between them.  An
+ * index is only used while the directory's inode reads the same as when it
+ * was built.  Everything is guarded by lock, which isn't held while a
+ * directory is being read.
+ */
+#define DIRINDEX_HASH_MIN 32
+#define DENTRY_BUCKETS 1024
+#define DENTRY_CACHE_ENTRIES (1 << 18)
+
+struct dirindex {
+  int dirinumber;
+  struct inode in;
+  int numEntries;
+  struct direntv6 *entries;
+  int numBuckets;  // a power of two, or 0 for a directory that's scanned
+  int *buckets;    // the first entry in each bucket, and then
+  int *chain;      // the next entry in the same bucket, with -1 ending both
+  struct dirindex *prev, *next;
+  struct dirindex *hashNext;
+};
+
+struct dentrycache {
+  pthread_mutex_t lock;
+  struct dirindex *buckets[DENTRY_BUCKETS];
+  struct dirindex *head, *tail;
+  int numEntries;
+};
+
+static unsigned int dirindex_hash(const char *name) {
+  unsigned int hash = 2166136261u;
+  for (int i = 0; i < 14 && name[i] != '\0'; i++) hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+  return hash;
+}
+
+/**
+ * v6 names are NUL padded to 14 characters, and aren't terminated at all if
+ * they take up all 14.  Entries with an inumber of 0 are free slots.
+ */
+static int dirindex_matches(const struct direntv6 *entry, const char *name) {
+  return entry->d_inumber != 0 && strncmp(entry->d_name, name, 14) == 0;
+}
+
+static void dirindex_free(struct dirindex *index) {
+  free(index->entries);
+  free(index->buckets);
+  free(index->chain);
+  free(index);
+}
+
+/**
+ * Reads the specified directory (whose inode is in) and returns a new index
+ * of it, or NULL if it can't be read.
+ */
+static struct dirindex *dirindex_build(struct unixfilesystem *fs, int dirinumber, struct inode *in) {
+  struct dirindex *index = calloc(1, sizeof(struct dirindex));
+  if (index == NULL) return NULL;
+  index->dirinumber = dirinumber;
+  index->in = *in;
+  int dirSize = inode_getsize(in);
+  index->numEntries = dirSize / sizeof(struct direntv6);
+  index->entries = malloc(dirSize > 0 ? dirSize : 1);
+  if (index->entries == NULL || file_read(fs, dirinumber, 0, dirSize, index->entries) != dirSize) {
+    dirindex_free(index);
+    return NULL;
+  }
+
+  if (index->numEntries < DIRINDEX_HASH_MIN) return index;
+  int numBuckets = 1;
+  while (numBuckets < index->numEntries) numBuckets *= 2;
+  index->buckets = malloc(numBuckets * sizeof(int));
+  index->chain = malloc(index->numEntries * sizeof(int));
+  if (index->buckets == NULL || index->chain == NULL) {
+    dirindex_free(index);
+    return NULL;
+  }
+  index->numBuckets = numBuckets;
+  for (int b = 0; b < numBuckets; b++) index->buckets[b] = -1;
+  for (int i = index->numEntries - 1; i >= 0; i--) { // so that each chain runs in directory order
+    int b = dirindex_hash(index->entries[i].d_name) & (numBuckets - 1);
+    index->chain[i] = index->buckets[b];
+    index->buckets[b] = i;
+  }
+  return index;
+}
+
+/**
+ * Returns the first entry in the index with the specified name, or NULL.
+ */
+static const struct direntv6 *dirindex_find(const struct dirindex *index, const char *name) {
+  if (index->numBuckets == 0) {
+    for (int i = 0; i < index->numEntries; i++) {
+      if (dirindex_matches(&index->entries[i], name)) return &index->entries[i];
+    }
+    return NULL;
+  }
+
+  int b = dirindex_hash(name) & (index->numBuckets - 1);
+  for (int i = index->buckets[b]; i != -1; i = index->chain[i]) {
+    if (dirindex_matches(&index->entries[i], name)) return &index->entries[i];
+  }
+  return NULL;
+}
+
+static struct dirindex **dentrycache_bucket(struct dentrycache *cache, int dirinumber) {
+  return &cache->buckets[dirinumber % DENTRY_BUCKETS];
+}
+
+static void dentrycache_unlink(struct dentrycache *cache, struct dirindex *index) {
+  if (index->prev == NULL) cache->head = index->next; else index->prev->next = index->next;
+  if (index->next == NULL) cache->tail = index->prev; else index->next->prev = index->prev;
+}
+
+static void dentrycache_pushfront(struct dentrycache *cache, struct dirindex *index) {
+  index->prev = NULL;
+  index->next = cache->head;
+  if (cache->head != NULL) cache->head->prev = index; else cache->tail = index;
+  cache->head = index;
+}
+
+static void dentrycache_remove(struct dentrycache *cache, struct dirindex *index) {
+  dentrycache_unlink(cache, index);
+  struct dirindex **link = dentrycache_bucket(cache, index->dirinumber);
+  while (*link != index) link = &(*link)->hashNext;
+  *link = index->hashNext;
+  cache->numEntries -= index->numEntries;
+  dirindex_free(index);
+}
+
+static struct dirindex *dentrycache_find(struct dentrycache *cache, int dirinumber) {
+  struct dirindex *index = *dentrycache_bucket(cache, dirinumber);
+  while (index != NULL && index->dirinumber != dirinumber) index = index->hashNext;
+  return index;
+}
+
+static void dentrycache_insert(struct dentrycache *cache, struct dirindex *index) {
+  struct dirindex *old = dentrycache_find(cache, index->dirinumber);
+  if (old != NULL) dentrycache_remove(cache, old);
+  while (cache->tail != NULL && cache->numEntries + index->numEntries > DENTRY_CACHE_ENTRIES) {
+    dentrycache_remove(cache, cache->tail);
+  }
+
+  struct dirindex **bucket = dentrycache_bucket(cache, index->dirinumber);
+  index->hashNext = *bucket;
+  *bucket = index;
+  dentrycache_pushfront(cache, index);
+  cache->numEntries += index->numEntries;
+}
+
+int directory_initcache(struct unixfilesystem *fs) {
+  struct dentrycache *cache = calloc(1, sizeof(struct dentrycache));
+  if (cache == NULL) return -1;
+  pthread_mutex_init(&cache->lock, NULL);
+  fs->dentries = cache;
+  return 0;
+}
+
+void directory_freecache(struct unixfilesystem *fs) {
+  struct dentrycache *cache = fs->dentries;
+  if (cache == NULL) return;
+  while (cache->head != NULL) dentrycache_remove(cache, cache->head);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+  fs->dentries = NULL;
+}
+
+int directory_iterinit(struct unixfilesystem *fs, int dirinumber, struct directory_iter *iter) {
+  struct inode in;
+  if (inode_iget(fs, dirinumber, &in) < 0) return -1;
+  if (!(in.i_mode & IALLOC) || ((in.i_mode & IFMT) != IFDIR)) return -1;
+  iter->fs = fs;
+  iter->dirinumber = dirinumber;
+  iter->size = inode_getsize(&in);
+  iter->offset = 0;
+  iter->numBuffered = iter->next = 0;
+  return 0;
+}
+
+int directory_iternext(struct directory_iter *iter, struct direntv6 *dirEnt) {
+  if (iter->next == iter->numBuffered) {
+    if (iter->offset >= iter->size) return 0;
+    int bytesRead = file_read(iter->fs, iter->dirinumber, iter->offset, sizeof(iter->entries), iter->entries);
+    if (bytesRead < 0) return -1;
+    iter->numBuffered = bytesRead / sizeof(struct direntv6);
+    iter->next = 0;
+    iter->offset += sizeof(iter->entries);
+    if (iter->numBuffered == 0) return 0;
+  }
+  *dirEnt = iter->entries[iter->next++];
+  return 1;
+}
 
 int directory_findname(struct unixfilesystem *fs, const char *name,
                        int dirinumber, struct direntv6 *dirEnt) {
@@ -24,20 +224,32 @@ int directory_findname(struct unixfilesystem *fs, const char *name,
   }
   int dirSize = inode_getsize(&dirInode);
   if (dirSize == 0) return -1; // empty directory
-  char dirBuffer[dirSize];
-  int numBlocks = dirSize / DISKIMG_SECTOR_SIZE + ((dirSize % DISKIMG_SECTOR_SIZE != 0) ? 1 : 0);
-  for (int i = 0; i < numBlocks; i++) {
-    int numValidBytes = file_getblock(fs, dirinumber, i, dirBuffer + i * DISKIMG_SECTOR_SIZE);
-    if (numValidBytes == -1) return -1;
-  }
-  size_t dirEntSize = sizeof(struct direntv6);
-  int numDirEnt = dirSize / dirEntSize;
-  for (int i = 0; i < numDirEnt; i++) {
-    char *dirEntP = dirBuffer + dirEntSize * i;
-    if (memcmp(dirEntP + sizeof(uint16_t), name, nameLen) == 0) {
-      memcpy(dirEnt, dirEntP, dirEntSize);
-      return 0;
+
+  struct dentrycache *cache = fs->dentries;
+  if (cache != NULL) {
+    pthread_mutex_lock(&cache->lock);
+    struct dirindex *index = dentrycache_find(cache, dirinumber);
+    if (index != NULL && memcmp(&index->in, &dirInode, sizeof(struct inode)) == 0) {
+      dentrycache_unlink(cache, index);
+      dentrycache_pushfront(cache, index);
+      const struct direntv6 *found = dirindex_find(index, name);
+      if (found != NULL) *dirEnt = *found;
+      pthread_mutex_unlock(&cache->lock);
+      return found != NULL ? 0 : -1;
     }
+    pthread_mutex_unlock(&cache->lock);
+  }
+
+  struct dirindex *index = dirindex_build(fs, dirinumber, &dirInode);
+  if (index == NULL) return -1;
+  const struct direntv6 *found = dirindex_find(index, name);
+  if (found != NULL) *dirEnt = *found;
+  if (cache == NULL) {
+    dirindex_free(index);
+  } else {
+    pthread_mutex_lock(&cache->lock);
+    dentrycache_insert(cache, index);
+    pthread_mutex_unlock(&cache->lock);
   }
-  return -1; // not found
+  return found != NULL ? 0 : -1; // not found
 }
@@ -8,8 +8,53 @@
  * Looks up the specified name (name) in the specified directory (dirinumber).  
  * If found, return the directory entry in space addressed by dirEnt.  Returns 0 
  * on success and something negative on failure. 
+ * Names must match exactly (up to the 14 characters an entry holds), and
+ * free entries (inumber 0) never match.  Each directory is read once and
+ * kept, indexed, in fs's dentry cache for later lookups, with directories
+ * of 32 or more entries hashed by name.
  */
 int directory_findname(struct unixfilesystem *fs, const char *name,
                        int dirinumber, struct direntv6 *dirEnt);
 
+/**
+ * Reads a directory's entries a few sectors at a time, so that walking one
+ * needs only this much memory however big the directory is.
+ */
+#define DIRECTORY_ITER_ENTRIES (8 * 512 / sizeof(struct direntv6))
+
+struct directory_iter {
+  struct unixfilesystem *fs;
+  int dirinumber;
+  int size;         // The directory's size in bytes.
+  int offset;       // Where the entries after those buffered start.
+  int numBuffered;
+  int next;         // The next of the buffered entries to return.
+  struct direntv6 entries[DIRECTORY_ITER_ENTRIES];
+};
+
+/**
+ * Starts iter at the first entry of the specified directory.  Returns 0 on
+ * success, and -1 if dirinumber can't be read or isn't an allocated
+ * directory.
+ */
+int directory_iterinit(struct unixfilesystem *fs, int dirinumber, struct directory_iter *iter);
+
+/**
+ * Copies the next entry (free ones included, in the order they're stored)
+ * into dirEnt.  Returns 1 if there was one, 0 at the end of the directory,
+ * and -1 if the directory couldn't be read.
+ */
+int directory_iternext(struct directory_iter *iter, struct direntv6 *dirEnt);
+
+/**
+ * Allocates fs->dentries, which unixfilesystem_initwithflags does.  Returns
+ * 0 on success, -1 on error.  Lookups are safe from multiple threads.
+ */
+int directory_initcache(struct unixfilesystem *fs);
+
+/**
+ * Frees fs->dentries and every index in it.
+ */
+void directory_freecache(struct unixfilesystem *fs);
+
 #endif // _DIECTORY_H_
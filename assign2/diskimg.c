@@ -1,31 +1,330 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "diskimg.h"
 
-int diskimg_open(char *pathname, int readOnly) {
-  return open(pathname, readOnly ? O_RDONLY : O_RDWR);
+/**
+ * The sector cache is a fixed pool of entries, each on exactly one of two
+ * lists threaded through prev and next: the free list, or the LRU list
+ * (most recently used at head).  Entries in use are also chained into
+ * hash buckets, keyed on descriptor and sector, through hashNext.  Links
+ * are indices into the pool, with -1 marking the end of a list.  Free
+ * entries have an fd of -1.  Everything is guarded by cacheLock, which is
+ * never held across the disk reads themselves.
+ */
+struct cacheentry {
+  int fd;
+  int sectorNum;
+  int prev, next;
+  int hashNext;
+  char data[DISKIMG_SECTOR_SIZE];
+};
+
+static struct {
+  int initialized;
+  int numEntries;
+  int numBuckets;  // a power of two
+  struct cacheentry *entries;
+  int *buckets;
+  int head, tail;
+  int freeList;
+  unsigned long writeCount;  // bumped by every write, so a read that raced one isn't cached
+  struct diskimg_cachestats stats;
+} cache;
+
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The images opened with DISKIMG_MMAP, indexed by descriptor.  A NULL base
+ * means the descriptor isn't mapped.  The table is split into chunks that,
+ * once allocated, never move, so that lookups (which happen for every
+ * sector, from any number of threads) needn't take a lock.  Only opening
+ * and closing do, and an image must not be closed while it's being read.
+ */
+struct mapping {
+  char *base;  // mapped PROT_READ, but kept non-const so it can be handed back to munmap
+  size_t size;
+};
+
+#define MAPPINGS_PER_CHUNK 64
+#define MAX_MAPPING_CHUNKS 1024  // enough for descriptors up to 65535
+
+static struct mapping *mappingChunks[MAX_MAPPING_CHUNKS];
+static pthread_mutex_t mappingLock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct mapping *mapping_find(int fd) {
+  if (fd < 0 || fd >= MAPPINGS_PER_CHUNK * MAX_MAPPING_CHUNKS) return NULL;
+  struct mapping *chunk = __atomic_load_n(&mappingChunks[fd / MAPPINGS_PER_CHUNK], __ATOMIC_ACQUIRE);
+  if (chunk == NULL || chunk[fd % MAPPINGS_PER_CHUNK].base == NULL) return NULL;
+  return &chunk[fd % MAPPINGS_PER_CHUNK];
+}
+
+static int mapping_add(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || fd >= MAPPINGS_PER_CHUNK * MAX_MAPPING_CHUNKS) return -1;
+  // mmap refuses empty files, and an empty image has no sectors to map anyway
+  if (st.st_size == 0) return 0;
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) return -1;
+
+  pthread_mutex_lock(&mappingLock);
+  struct mapping *chunk = mappingChunks[fd / MAPPINGS_PER_CHUNK];
+  if (chunk == NULL) {
+    chunk = calloc(MAPPINGS_PER_CHUNK, sizeof(struct mapping));
+    if (chunk == NULL) {
+      pthread_mutex_unlock(&mappingLock);
+      munmap(base, st.st_size);
+      return -1;
+    }
+    __atomic_store_n(&mappingChunks[fd / MAPPINGS_PER_CHUNK], chunk, __ATOMIC_RELEASE);
+  }
+  chunk[fd % MAPPINGS_PER_CHUNK].size = st.st_size;
+  chunk[fd % MAPPINGS_PER_CHUNK].base = base;
+  pthread_mutex_unlock(&mappingLock);
+  return 0;
+}
+
+static void mapping_remove(int fd) {
+  pthread_mutex_lock(&mappingLock);
+  struct mapping *m = mapping_find(fd);
+  if (m != NULL) {
+    munmap(m->base, m->size);
+    m->base = NULL;
+    m->size = 0;
+  }
+  pthread_mutex_unlock(&mappingLock);
+}
+
+static int cache_bucket(int fd, int sectorNum) {
+  unsigned int key = (unsigned int) sectorNum * 2654435761u ^ (unsigned int) fd * 40503u;
+  return key & (cache.numBuckets - 1);
+}
+
+static void cache_unlink(int i) {
+  struct cacheentry *e = &cache.entries[i];
+  if (e->prev == -1) cache.head = e->next; else cache.entries[e->prev].next = e->next;
+  if (e->next == -1) cache.tail = e->prev; else cache.entries[e->next].prev = e->prev;
+}
+
+static void cache_pushfront(int i) {
+  struct cacheentry *e = &cache.entries[i];
+  e->prev = -1;
+  e->next = cache.head;
+  if (cache.head != -1) cache.entries[cache.head].prev = i; else cache.tail = i;
+  cache.head = i;
+}
+
+static void cache_unhash(int i) {
+  struct cacheentry *e = &cache.entries[i];
+  int *link = &cache.buckets[cache_bucket(e->fd, e->sectorNum)];
+  while (*link != i) link = &cache.entries[*link].hashNext;
+  *link = e->hashNext;
+}
+
+static int cache_find(int fd, int sectorNum) {
+  if (cache.numEntries == 0) return -1;
+  int i = cache.buckets[cache_bucket(fd, sectorNum)];
+  while (i != -1 && (cache.entries[i].fd != fd || cache.entries[i].sectorNum != sectorNum)) {
+    i = cache.entries[i].hashNext;
+  }
+  return i;
+}
+
+static void cache_release(int i) {
+  cache_unlink(i);
+  cache_unhash(i);
+  cache.entries[i].fd = -1;
+  cache.entries[i].next = cache.freeList;
+  cache.freeList = i;
+}
+
+/**
+ * Claims an entry for the specified sector, taking a free one if there is one
+ * and otherwise evicting the least recently used, and moves it to the front
+ * of the LRU list.  The caller fills in the data.
+ */
+static int cache_claim(int fd, int sectorNum) {
+  int i = cache.freeList;
+  if (i != -1) {
+    cache.freeList = cache.entries[i].next;
+  } else {
+    i = cache.tail;
+    cache_unlink(i);
+    cache_unhash(i);
+  }
+
+  struct cacheentry *e = &cache.entries[i];
+  e->fd = fd;
+  e->sectorNum = sectorNum;
+  int bucket = cache_bucket(fd, sectorNum);
+  e->hashNext = cache.buckets[bucket];
+  cache.buckets[bucket] = i;
+  cache_pushfront(i);
+  return i;
+}
+
+static int cache_resize(int numSectors) {
+  free(cache.entries);
+  free(cache.buckets);
+  unsigned long writeCount = cache.writeCount;
+  memset(&cache, 0, sizeof(cache));
+  cache.writeCount = writeCount;
+  cache.initialized = 1;
+  cache.head = cache.tail = cache.freeList = -1;
+  if (numSectors <= 0) return 0;
+
+  int numBuckets = 1;
+  while (numBuckets < 2 * numSectors) numBuckets *= 2;
+  cache.entries = malloc(numSectors * sizeof(struct cacheentry));
+  cache.buckets = malloc(numBuckets * sizeof(int));
+  if (cache.entries == NULL || cache.buckets == NULL) {
+    free(cache.entries);
+    free(cache.buckets);
+    cache.entries = NULL;
+    cache.buckets = NULL;
+    return -1;
+  }
+
+  cache.numEntries = numSectors;
+  cache.numBuckets = numBuckets;
+  for (int b = 0; b < numBuckets; b++) cache.buckets[b] = -1;
+  for (int i = 0; i < numSectors; i++) {
+    cache.entries[i].fd = -1;
+    cache.entries[i].next = i + 1 < numSectors ? i + 1 : -1;
+  }
+  cache.freeList = 0;
+  return 0;
+}
+
+int diskimg_setcachesize(int numSectors) {
+  pthread_mutex_lock(&cacheLock);
+  int result = cache_resize(numSectors);
+  pthread_mutex_unlock(&cacheLock);
+  return result;
+}
+
+void diskimg_getcachestats(struct diskimg_cachestats *stats) {
+  pthread_mutex_lock(&cacheLock);
+  *stats = cache.stats;
+  pthread_mutex_unlock(&cacheLock);
+}
+
+int diskimg_open(char *pathname, int flags) {
+  pthread_mutex_lock(&cacheLock);
+  if (!cache.initialized) cache_resize(DISKIMG_DEFAULT_CACHE_SECTORS);
+  pthread_mutex_unlock(&cacheLock);
+  int fd = open(pathname, (flags & (DISKIMG_READONLY | DISKIMG_MMAP)) ? O_RDONLY : O_RDWR);
+  if (fd == -1 || !(flags & DISKIMG_MMAP)) return fd;
+  if (mapping_add(fd) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
 }
 
 int diskimg_getsize(int fd) {
   return lseek(fd, 0, SEEK_END);
 }
 
+const void *diskimg_getsectorptr(int fd, int sectorNum) {
+  const struct mapping *m = mapping_find(fd);
+  if (m == NULL || sectorNum < 0 || (size_t) (sectorNum + 1) * DISKIMG_SECTOR_SIZE > m->size) return NULL;
+  return m->base + (size_t) sectorNum * DISKIMG_SECTOR_SIZE;
+}
+
+int diskimg_readv(int fd, int sectorNum, const struct iovec *iov, int iovcnt) {
+  if (sectorNum < 0) return -1;
+  size_t offset = (size_t) sectorNum * DISKIMG_SECTOR_SIZE;
+  const struct mapping *m = mapping_find(fd);
+  if (m == NULL) return preadv(fd, iov, iovcnt, offset);
+
+  size_t numRead = 0;
+  for (int i = 0; i < iovcnt && offset < m->size; i++) {
+    size_t numBytes = m->size - offset < iov[i].iov_len ? m->size - offset : iov[i].iov_len;
+    memcpy(iov[i].iov_base, m->base + offset, numBytes);
+    offset += numBytes;
+    numRead += numBytes;
+  }
+  return numRead;
+}
+
+const void *diskimg_accesssector(int fd, int sectorNum, void *buf) {
+  const void *sector = diskimg_getsectorptr(fd, sectorNum);
+  if (sector != NULL) return sector;
+  return diskimg_readsector(fd, sectorNum, buf) == DISKIMG_SECTOR_SIZE ? buf : NULL;
+}
+
 int diskimg_readsector(int fd, int sectorNum,  void *buf) {
-  if (lseek(fd, sectorNum * DISKIMG_SECTOR_SIZE, SEEK_SET) == (off_t) -1) return -1;  
-  return read(fd, buf, DISKIMG_SECTOR_SIZE);
+  const struct mapping *m = mapping_find(fd);
+  if (m != NULL) {
+    if (sectorNum < 0) return -1;
+    size_t offset = (size_t) sectorNum * DISKIMG_SECTOR_SIZE;
+    if (offset >= m->size) return 0;
+    size_t numRead = m->size - offset < DISKIMG_SECTOR_SIZE ? m->size - offset : DISKIMG_SECTOR_SIZE;
+    memcpy(buf, m->base + offset, numRead);
+    return numRead;
+  }
+
+  pthread_mutex_lock(&cacheLock);
+  int i = cache_find(fd, sectorNum);
+  if (i != -1) {
+    cache.stats.hits++;
+    cache_unlink(i);
+    cache_pushfront(i);
+    memcpy(buf, cache.entries[i].data, DISKIMG_SECTOR_SIZE);
+    pthread_mutex_unlock(&cacheLock);
+    return DISKIMG_SECTOR_SIZE;
+  }
+  cache.stats.misses++;
+  unsigned long writeCount = cache.writeCount;
+  pthread_mutex_unlock(&cacheLock);
+
+  if (sectorNum < 0) return -1;
+  int numRead = pread(fd, buf, DISKIMG_SECTOR_SIZE, (off_t) sectorNum * DISKIMG_SECTOR_SIZE);
+  if (numRead != DISKIMG_SECTOR_SIZE) return numRead;
+
+  // another thread may have read the same sector in the meantime, or written to the disk
+  pthread_mutex_lock(&cacheLock);
+  if (cache.numEntries > 0 && cache.writeCount == writeCount && cache_find(fd, sectorNum) == -1) {
+    memcpy(cache.entries[cache_claim(fd, sectorNum)].data, buf, DISKIMG_SECTOR_SIZE);
+  }
+  pthread_mutex_unlock(&cacheLock);
+  return numRead;
 }
 
 int diskimg_writesector(int fd, int sectorNum,  void *buf) {
-  if (lseek(fd, sectorNum * DISKIMG_SECTOR_SIZE, SEEK_SET) == (off_t) -1) {
+  if (sectorNum < 0) {
     return -1;
   }
 
-  return write(fd, buf, DISKIMG_SECTOR_SIZE);
+  // the write happens under the lock so that cached copies and writeCount change along with the disk
+  pthread_mutex_lock(&cacheLock);
+  int numWritten = pwrite(fd, buf, DISKIMG_SECTOR_SIZE, (off_t) sectorNum * DISKIMG_SECTOR_SIZE);
+  cache.writeCount++;
+  int i = cache_find(fd, sectorNum);
+  if (i != -1) {
+    if (numWritten == DISKIMG_SECTOR_SIZE) {
+      memcpy(cache.entries[i].data, buf, DISKIMG_SECTOR_SIZE);
+    } else { // the disk may hold some mix of old and new, so forget the sector
+      cache_release(i);
+    }
+  }
+  pthread_mutex_unlock(&cacheLock);
+  return numWritten;
 }
 
 int diskimg_close(int fd) {
+  pthread_mutex_lock(&cacheLock);
+  for (int i = 0; i < cache.numEntries; i++) {
+    if (cache.entries[i].fd == fd) cache_release(i);
+  }
+  pthread_mutex_unlock(&cacheLock);
+  mapping_remove(fd);
   return close(fd);
 }
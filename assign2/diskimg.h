@@ -2,15 +2,35 @@
 #define _DISKIMG_H_
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 // Size of a disk sector (e.g. block) in bytes.
 #define DISKIMG_SECTOR_SIZE 512
 
+// Flags for diskimg_open.  A mapped image is always read-only.
+#define DISKIMG_READONLY 1
+#define DISKIMG_MMAP     2
+
+// Number of sectors the sector cache holds unless diskimg_setcachesize says otherwise.
+#define DISKIMG_DEFAULT_CACHE_SECTORS 1024
+
+/**
+ * Hit and miss counts for the sector cache, accumulated across every open
+ * disk image since the last diskimg_setcachesize call.
+ */
+struct diskimg_cachestats {
+  uint64_t hits;
+  uint64_t misses;
+};
+
 /**
  * Opens a disk image for I/O. Returns an open file descriptor, or -1 if
- * unsuccessful.  
+ * unsuccessful.  flags is 0 or DISKIMG_READONLY, optionally or'ed with
+ * DISKIMG_MMAP to map the whole image into memory, in which case sectors
+ * are read without system calls (and bypass the sector cache) and can be
+ * accessed in place through diskimg_getsectorptr.
  */
-int diskimg_open(char *pathname, int readOnly);
+int diskimg_open(char *pathname, int flags);
 
 /**
  * Returns the size of the disk imgage in bytes, or -1 if unsuccessful.
@@ -19,20 +39,60 @@ int diskimg_getsize(int fd);
 
 /**
  * Reads the specified sector (e.g. block) from the disk.  Returns the number of bytes read,
- * or -1 on error.
+ * or -1 on error.  Sectors are served from a cache of the most recently read sectors
+ * whenever possible, so inode.c, file.c and directory.c can reread the same inode or
+ * indirect block without going back to the disk.
  */
 int diskimg_readsector(int fd, int sectorNum, void *buf); 
 
+/**
+ * Reads consecutive sectors, starting with the specified one, into the buffers
+ * described by iov, which must add up to a whole number of sectors, using a
+ * single preadv (or, for a mapped image, copying straight from the mapping).
+ * Bulk reads like these bypass the sector cache, which is left to metadata.
+ * Returns the number of bytes read, or -1 on error.
+ */
+int diskimg_readv(int fd, int sectorNum, const struct iovec *iov, int iovcnt);
+
+/**
+ * Returns a pointer to the specified sector within a disk image opened with
+ * DISKIMG_MMAP, which stays valid until the image is closed.  Returns NULL if
+ * the image isn't mapped or the sector lies beyond its end.
+ */
+const void *diskimg_getsectorptr(int fd, int sectorNum);
+
+/**
+ * Returns a pointer to the specified sector in place if the image is mapped,
+ * and otherwise reads the sector into buf (as diskimg_readsector would) and
+ * returns buf.  Returns NULL if the sector can't be read in full.  This lets
+ * read-only code skip the copy when it can and fall back when it can't.
+ */
+const void *diskimg_accesssector(int fd, int sectorNum, void *buf);
+
 /**
  * Writes the specified sector from the disk.  Returns the number of bytes
- * written, or -1 on error.
+ * written, or -1 on error.  The write goes straight to the disk, and any
+ * cached copy of the sector is updated to match.
  */
 int diskimg_writesector(int fd, int sectorNum, void *buf); 
 
 /**
  * Clean up from a previous diskimg_open() call.  Returns 0 on success, or -1 on
- * error.
+ * error.  Any of the disk's sectors still in the cache are dropped.
  */
 int diskimg_close(int fd);
 
+/**
+ * Empties the sector cache, resets its statistics, and resizes it to hold the
+ * specified number of sectors, least recently used first out.  A size of 0
+ * turns caching off.  Returns 0 on success, or -1 if memory runs out (in which
+ * case caching is left off).
+ */
+int diskimg_setcachesize(int numSectors);
+
+/**
+ * Fills in the sector cache's hit and miss counts.
+ */
+void diskimg_getcachestats(struct diskimg_cachestats *stats);
+
 #endif // _DISKIMG_H_
@@ -1,32 +1,166 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
+#include <sys/uio.h>
 
 #include "file.h"
 #include "inode.h"
 #include "diskimg.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
 
 int file_getblock(struct unixfilesystem *fs, int inumber, int blockNum, void *buf) {
+  char fileBuffer[DISKIMG_SECTOR_SIZE];
+  int numValidBytes;
+  const void *block = file_getblockptr(fs, inumber, blockNum, fileBuffer, &numValidBytes);
+  if (block == NULL) return -1;
+  memcpy(buf, block, numValidBytes);
+  return numValidBytes;
+}
+
+const void *file_getblockptr(struct unixfilesystem *fs, int inumber, int blockNum, void *buf,
+                             int *numValidBytes) {
   struct inode in;
   if (inode_iget(fs, inumber, &in) == -1) {
     fprintf(stderr, "error occurred when calling inode_iget.\n");
-    return -1;
+    return NULL;
   }
   int actualBlockNum = inode_indexlookup(fs, &in, blockNum);
   if (actualBlockNum == -1) {
     fprintf(stderr, "error occurred when calling inode_indexlookup.\n");
+    return NULL;
+  }
+  int fileSize = inode_getsize(&in);
+  *numValidBytes = MIN(fileSize - blockNum * DISKIMG_SECTOR_SIZE, DISKIMG_SECTOR_SIZE);
+  const void *block = diskimg_accesssector(fs->dfd, actualBlockNum, buf);
+  if (block == NULL) {
+    fprintf(stderr, "error occurred when calling diskimg_accesssector.\n");
+    return NULL;
+  }
+  return block;
+}
+
+/**
+ * Blocks wholly inside [offset, offset + len) are read straight into buf, and
+ * neighbors on disk share an iovec as they do in buf.  Only the first and last
+ * blocks can be partial, and they're read into head and tail and copied out.
+ * A run of contiguous blocks therefore needs at most three iovecs.
+ */
+int file_read(struct unixfilesystem *fs, int inumber, int offset, int len, void *buf) {
+  struct inode in;
+  if (offset < 0 || len < 0 || inode_iget(fs, inumber, &in) == -1) return -1;
+  int fileSize = inode_getsize(&in);
+  if (offset >= fileSize || len == 0) return 0;
+  len = MIN(len, fileSize - offset);
+
+  int firstBlock = offset / DISKIMG_SECTOR_SIZE;
+  int numBlocks = (offset + len - 1) / DISKIMG_SECTOR_SIZE - firstBlock + 1;
+  uint16_t stackBlockNums[64];
+  uint16_t *blockNums = numBlocks <= 64 ? stackBlockNums : malloc(numBlocks * sizeof(uint16_t));
+  if (blockNums == NULL || inode_indexlookuprange(fs, inumber, &in, firstBlock, numBlocks, blockNums) == -1) {
+    if (blockNums != stackBlockNums) free(blockNums);
+    fprintf(stderr, "error occurred when calling inode_indexlookuprange.\n");
     return -1;
   }
+
+  char *out = buf;
+  char head[DISKIMG_SECTOR_SIZE], tail[DISKIMG_SECTOR_SIZE];
+  int result = len;
+  for (int i = 0, j; i < numBlocks; i = j) {
+    for (j = i + 1; j < numBlocks && blockNums[j] == blockNums[j - 1] + 1; j++) ;
+    struct iovec iov[3];
+    int iovcnt = 0;
+    for (int b = i; b < j; b++) {
+      int blockStart = (firstBlock + b) * DISKIMG_SECTOR_SIZE;
+      int whole = blockStart >= offset && blockStart + DISKIMG_SECTOR_SIZE <= offset + len;
+      char *dest = !whole ? (b == 0 ? head : tail) : out + (blockStart - offset);
+      if (whole && iovcnt > 0 && (char *) iov[iovcnt - 1].iov_base + iov[iovcnt - 1].iov_len == dest) {
+        iov[iovcnt - 1].iov_len += DISKIMG_SECTOR_SIZE;
+      } else {
+        iov[iovcnt].iov_base = dest;
+        iov[iovcnt].iov_len = DISKIMG_SECTOR_SIZE;
+        iovcnt++;
+      }
+    }
+
+    if (diskimg_readv(fs->dfd, blockNums[i], iov, iovcnt) != (j - i) * DISKIMG_SECTOR_SIZE) {
+      fprintf(stderr, "error occurred when calling diskimg_readv.\n");
+      result = -1;
+      break;
+    }
+
+    for (int b = i; b < j; b += MAX(j - i - 1, 1)) { // just the first and last blocks of the run
+      int blockStart = (firstBlock + b) * DISKIMG_SECTOR_SIZE;
+      int lo = MAX(offset, blockStart), hi = MIN(offset + len, blockStart + DISKIMG_SECTOR_SIZE);
+      if (hi - lo == DISKIMG_SECTOR_SIZE) continue;
+      memcpy(out + (lo - offset), (b == 0 ? head : tail) + (lo - blockStart), hi - lo);
+    }
+  }
+
+  if (blockNums != stackBlockNums) free(blockNums);
+  return result;
+}
+
+// Unmapped files are read for file_readruns this many bytes at a time, so that file_read can batch up the disk reads.
+#define FILE_RUN_CHUNK (64 * DISKIMG_SECTOR_SIZE)
+
+static int file_readrunsunmapped(struct unixfilesystem *fs, int inumber, int offset, int len,
+                                 file_runvisitor visit, void *arg) {
+  char buf[FILE_RUN_CHUNK];
+  int numVisited = 0;
+  while (numVisited < len) {
+    int bytesRead = file_read(fs, inumber, offset + numVisited, MIN(len - numVisited, FILE_RUN_CHUNK), buf);
+    if (bytesRead < 0) return -1;
+    if (bytesRead == 0) break;
+    if (visit(buf, bytesRead, arg) != 0) return -1;
+    numVisited += bytesRead;
+  }
+  return numVisited;
+}
+
+/**
+ * Sector 0 lies within every image, so diskimg_getsectorptr only comes back
+ * NULL for it when the image isn't mapped.  The block map of the whole range
+ * is looked up in one pass, and then each run of blocks that are neighbors
+ * on disk is a single stretch of the mapping, trimmed to [offset, offset + len).
+ */
+int file_readruns(struct unixfilesystem *fs, int inumber, int offset, int len, file_runvisitor visit, void *arg) {
+  if (diskimg_getsectorptr(fs->dfd, 0) == NULL) return file_readrunsunmapped(fs, inumber, offset, len, visit, arg);
+  struct inode in;
+  if (offset < 0 || len < 0 || inode_iget(fs, inumber, &in) == -1) return -1;
   int fileSize = inode_getsize(&in);
-  int numValidBytes = MIN(fileSize - blockNum * DISKIMG_SECTOR_SIZE, DISKIMG_SECTOR_SIZE);
-  char fileBuffer[DISKIMG_SECTOR_SIZE];
-  int numRead = diskimg_readsector(fs->dfd, actualBlockNum, fileBuffer);
-  if (numRead == -1 || numRead != DISKIMG_SECTOR_SIZE) {
-    fprintf(stderr, "error occurred when calling diskimg_readsector.\n");
+  if (offset >= fileSize || len == 0) return 0;
+  len = MIN(len, fileSize - offset);
+
+  int firstBlock = offset / DISKIMG_SECTOR_SIZE;
+  int numBlocks = (offset + len - 1) / DISKIMG_SECTOR_SIZE - firstBlock + 1;
+  uint16_t stackBlockNums[64];
+  uint16_t *blockNums = numBlocks <= 64 ? stackBlockNums : malloc(numBlocks * sizeof(uint16_t));
+  if (blockNums == NULL || inode_indexlookuprange(fs, inumber, &in, firstBlock, numBlocks, blockNums) == -1) {
+    if (blockNums != stackBlockNums) free(blockNums);
+    fprintf(stderr, "error occurred when calling inode_indexlookuprange.\n");
     return -1;
   }
-  memcpy(buf, fileBuffer, numValidBytes);
-  return numValidBytes;
+
+  int result = len;
+  for (int i = 0, j; i < numBlocks; i = j) {
+    for (j = i + 1; j < numBlocks && blockNums[j] == blockNums[j - 1] + 1; j++) ;
+    const char *run = diskimg_getsectorptr(fs->dfd, blockNums[i]);
+    if (run == NULL || diskimg_getsectorptr(fs->dfd, blockNums[j - 1]) == NULL) {
+      fprintf(stderr, "error occurred when calling diskimg_getsectorptr.\n");
+      result = -1;
+      break;
+    }
+    int runStart = (firstBlock + i) * DISKIMG_SECTOR_SIZE;
+    int lo = MAX(offset, runStart), hi = MIN(offset + len, (firstBlock + j) * DISKIMG_SECTOR_SIZE);
+    if (visit(run + (lo - runStart), hi - lo, arg) != 0) {
+      result = -1;
+      break;
+    }
+  }
+
+  if (blockNums != stackBlockNums) free(blockNums);
+  return result;
 }
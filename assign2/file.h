@@ -9,4 +9,35 @@
  */
 int file_getblock(struct unixfilesystem *fs, int inumber, int blockNo, void *buf); 
 
+/**
+ * Like file_getblock, but rather than copying the block into the caller's
+ * buffer, returns a pointer to it: into the disk image itself when the image
+ * is mapped, and otherwise into buf, which must hold DISKIMG_SECTOR_SIZE
+ * bytes.  The number of valid bytes is returned through numValidBytes.
+ * Returns NULL on error.
+ */
+const void *file_getblockptr(struct unixfilesystem *fs, int inumber, int blockNo, void *buf,
+                             int *numValidBytes);
+
+/**
+ * Reads up to len bytes of the specified file, starting at byte offset, into
+ * buf.  The blocks involved are all mapped in one pass over the inode and its
+ * indirect blocks, and each run of them that's contiguous on disk is read
+ * with a single diskimg_readv.  Returns the number of bytes read, which falls
+ * short of len only at the end of the file, or -1 on error.
+ */
+int file_read(struct unixfilesystem *fs, int inumber, int offset, int len, void *buf);
+
+/**
+ * Hands the bytes of the specified file, from offset on and up to len of
+ * them, to visit in file order, a run at a time.  When the image is mapped,
+ * each run is a stretch of blocks contiguous on disk, handed over in place
+ * without being copied; otherwise the file is read with file_read into a
+ * buffer a chunk at a time.  visit returns 0 to keep going and anything else
+ * to stop.  Returns the number of bytes visited, which falls short of len
+ * only at the end of the file, or -1 on error or if visit stops early.
+ */
+typedef int (*file_runvisitor)(const void *bytes, int len, void *arg);
+int file_readruns(struct unixfilesystem *fs, int inumber, int offset, int len, file_runvisitor visit, void *arg);
+
 #endif // _FILE_H_
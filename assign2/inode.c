@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include "inode.h"
 #include "diskimg.h"
@@ -13,15 +15,20 @@ int inode_iget(struct unixfilesystem *fs, int inumber, struct inode *inp) {
     return -1;
   }
 
+  if (fs->inodes != NULL) {
+    *inp = fs->inodes[inumber - 1];
+    return 0;
+  }
+
   int sectorNum = (inumber - 1) * inodeSize / DISKIMG_SECTOR_SIZE + INODE_START_SECTOR;
   int locationInSector = (inumber - 1) * inodeSize % DISKIMG_SECTOR_SIZE;
   char buffer[DISKIMG_SECTOR_SIZE];
-  int numRead = diskimg_readsector(fs->dfd, sectorNum, buffer);
-  if (numRead == -1 || numRead != DISKIMG_SECTOR_SIZE) {
-    fprintf(stderr, "error occurred when calling diskimg_readsector.\n");
+  const char *sector = diskimg_accesssector(fs->dfd, sectorNum, buffer);
+  if (sector == NULL) {
+    fprintf(stderr, "error occurred when calling diskimg_accesssector.\n");
     return -1;
   }
-  memcpy(inp, buffer + locationInSector, inodeSize);
+  memcpy(inp, sector + locationInSector, inodeSize);
   return 0;
 }
 
@@ -47,10 +54,10 @@ int inode_indexlookup(struct unixfilesystem *fs, struct inode *inp, int blockNum
     int firstIndirectIndex = blockNum / numPerBlock;
     firstIndirectIndex = (firstIndirectIndex < N_BLOCKS - 1) ? firstIndirectIndex : (N_BLOCKS - 1);
     char buffer[DISKIMG_SECTOR_SIZE];
-    int numRead = diskimg_readsector(fs->dfd, inp->i_addr[firstIndirectIndex], buffer);
-    if (numRead == -1 || numRead != DISKIMG_SECTOR_SIZE) return -1;
+    const uint16_t *indirect = diskimg_accesssector(fs->dfd, inp->i_addr[firstIndirectIndex], buffer);
+    if (indirect == NULL) return -1;
     if (firstIndirectIndex != N_BLOCKS - 1) { // singly indirect
-      actualBlockNum = *(((uint16_t *) buffer) + blockNum % numPerBlock);
+      actualBlockNum = indirect[blockNum % numPerBlock];
     } else { // doubly indirect
       int restBlockNum = blockNum - numPerBlock * (N_BLOCKS - 1);
       int secondIndirectIndex = restBlockNum / numPerBlock;
@@ -58,15 +65,224 @@ int inode_indexlookup(struct unixfilesystem *fs, struct inode *inp, int blockNum
         fprintf(stderr, "file size %d not supported.\n", fileSize);
         return -1;
       }
-      uint16_t singlyIndirectBlockNum = *(((uint16_t *) buffer) + secondIndirectIndex);
-      int numRead = diskimg_readsector(fs->dfd, singlyIndirectBlockNum, buffer);
-      if (numRead == -1 || numRead != DISKIMG_SECTOR_SIZE) return -1;
-      actualBlockNum = *(((uint16_t *) buffer) + restBlockNum % numPerBlock);
+      uint16_t singlyIndirectBlockNum = indirect[secondIndirectIndex];
+      indirect = diskimg_accesssector(fs->dfd, singlyIndirectBlockNum, buffer);
+      if (indirect == NULL) return -1;
+      actualBlockNum = indirect[restBlockNum % numPerBlock];
     }
     return actualBlockNum;
   }
 }
 
+static int inode_getnumblocks(struct inode *inp) {
+  int fileSize = inode_getsize(inp);
+  return fileSize / DISKIMG_SECTOR_SIZE + ((fileSize % DISKIMG_SECTOR_SIZE != 0) ? 1 : 0);
+}
+
+int inode_getblockmap(struct unixfilesystem *fs, struct inode *inp, uint16_t *out, int maxBlocks) {
+  if (maxBlocks < 0) return -1;
+  if ((inp->i_mode & IALLOC) == 0) {
+    fprintf(stderr, "inode is unallocated.\n");
+    return -1;
+  }
+
+  int numFileBlocks = inode_getnumblocks(inp);
+  int numBlocks = numFileBlocks < maxBlocks ? numFileBlocks : maxBlocks;
+  if ((inp->i_mode & ILARG) == 0) {
+    if (numBlocks > N_BLOCKS) return -1;
+    memcpy(out, inp->i_addr, numBlocks * sizeof(uint16_t));
+    return numFileBlocks;
+  }
+
+  // indirect holds the singly indirect block currently in use, which is indirectNum;
+  // doubly holds the doubly indirect block, once it's needed
+  int numPerBlock = DISKIMG_SECTOR_SIZE / sizeof(uint16_t);
+  char indirectBuffer[DISKIMG_SECTOR_SIZE], doublyBuffer[DISKIMG_SECTOR_SIZE];
+  const uint16_t *indirect = NULL, *doubly = NULL;
+  int indirectNum = -1;
+  for (int blockNum = 0; blockNum < numBlocks; blockNum++) {
+    int firstIndirectIndex = blockNum / numPerBlock;
+    int singlyIndirectBlockNum;
+    if (firstIndirectIndex < N_BLOCKS - 1) {
+      singlyIndirectBlockNum = inp->i_addr[firstIndirectIndex];
+    } else {
+      int secondIndirectIndex = (blockNum - numPerBlock * (N_BLOCKS - 1)) / numPerBlock;
+      if (secondIndirectIndex >= numPerBlock) {
+        fprintf(stderr, "file size %d not supported.\n", inode_getsize(inp));
+        return -1;
+      }
+      if (doubly == NULL) {
+        doubly = diskimg_accesssector(fs->dfd, inp->i_addr[N_BLOCKS - 1], doublyBuffer);
+        if (doubly == NULL) return -1;
+      }
+      singlyIndirectBlockNum = doubly[secondIndirectIndex];
+    }
+
+    if (singlyIndirectBlockNum != indirectNum) {
+      indirect = diskimg_accesssector(fs->dfd, singlyIndirectBlockNum, indirectBuffer);
+      if (indirect == NULL) return -1;
+      indirectNum = singlyIndirectBlockNum;
+    }
+    out[blockNum] = indirect[blockNum % numPerBlock];
+  }
+  return numFileBlocks;
+}
+
+/**
+ * The block map cache, one per filesystem.  Entries are chained into buckets
+ * by inumber and kept on a list, most recently used first, and the least
+ * recently used are freed once the maps add up to more than
+ * BLOCKMAP_CACHE_BLOCKS block numbers.  lock guards all of it, but isn't held
+ * while a map is being built.
+ */
+#define BLOCKMAP_BUCKETS 1024
+#define BLOCKMAP_CACHE_BLOCKS (1 << 20)
+
+struct blockmap {
+  int inumber;
+  struct inode in;  // the inode the map was built from
+  int numBlocks;
+  uint16_t *blockNums;
+  struct blockmap *prev, *next;
+  struct blockmap *hashNext;
+};
+
+struct blockmapcache {
+  pthread_mutex_t lock;
+  struct blockmap *buckets[BLOCKMAP_BUCKETS];
+  struct blockmap *head, *tail;
+  int numBlocks;
+};
+
+static struct blockmap **blockmap_bucket(struct blockmapcache *cache, int inumber) {
+  return &cache->buckets[inumber % BLOCKMAP_BUCKETS];
+}
+
+static void blockmap_unlink(struct blockmapcache *cache, struct blockmap *m) {
+  if (m->prev == NULL) cache->head = m->next; else m->prev->next = m->next;
+  if (m->next == NULL) cache->tail = m->prev; else m->next->prev = m->prev;
+}
+
+static void blockmap_pushfront(struct blockmapcache *cache, struct blockmap *m) {
+  m->prev = NULL;
+  m->next = cache->head;
+  if (cache->head != NULL) cache->head->prev = m; else cache->tail = m;
+  cache->head = m;
+}
+
+static void blockmap_remove(struct blockmapcache *cache, struct blockmap *m) {
+  blockmap_unlink(cache, m);
+  struct blockmap **link = blockmap_bucket(cache, m->inumber);
+  while (*link != m) link = &(*link)->hashNext;
+  *link = m->hashNext;
+  cache->numBlocks -= m->numBlocks;
+  free(m->blockNums);
+  free(m);
+}
+
+static struct blockmap *blockmap_find(struct blockmapcache *cache, int inumber) {
+  struct blockmap *m = *blockmap_bucket(cache, inumber);
+  while (m != NULL && m->inumber != inumber) m = m->hashNext;
+  return m;
+}
+
+/**
+ * Adds a freshly built map to the cache (replacing any older one for the same
+ * inode), or frees it if it's too big to keep.  Must be called with the
+ * cache's lock held.
+ */
+static void blockmap_insert(struct blockmapcache *cache, struct blockmap *m) {
+  struct blockmap *old = blockmap_find(cache, m->inumber);
+  if (old != NULL) blockmap_remove(cache, old);
+  if (m->numBlocks > BLOCKMAP_CACHE_BLOCKS) {
+    free(m->blockNums);
+    free(m);
+    return;
+  }
+  while (cache->tail != NULL && cache->numBlocks + m->numBlocks > BLOCKMAP_CACHE_BLOCKS) {
+    blockmap_remove(cache, cache->tail);
+  }
+
+  struct blockmap **bucket = blockmap_bucket(cache, m->inumber);
+  m->hashNext = *bucket;
+  *bucket = m;
+  blockmap_pushfront(cache, m);
+  cache->numBlocks += m->numBlocks;
+}
+
+int inode_initcache(struct unixfilesystem *fs) {
+  struct blockmapcache *cache = calloc(1, sizeof(struct blockmapcache));
+  if (cache == NULL) return -1;
+  pthread_mutex_init(&cache->lock, NULL);
+  fs->blockmaps = cache;
+  return 0;
+}
+
+void inode_freecache(struct unixfilesystem *fs) {
+  struct blockmapcache *cache = fs->blockmaps;
+  if (cache == NULL) return;
+  while (cache->head != NULL) blockmap_remove(cache, cache->head);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+  fs->blockmaps = NULL;
+}
+
+int inode_indexlookuprange(struct unixfilesystem *fs, int inumber, struct inode *inp, int firstBlock,
+                           int numBlocks, uint16_t *blockNums) {
+  if ((inp->i_mode & IALLOC) == 0) {
+    fprintf(stderr, "inode is unallocated.\n");
+    return -1;
+  }
+
+  int numFileBlocks = inode_getnumblocks(inp);
+  if (firstBlock < 0 || numBlocks < 0 || firstBlock + numBlocks > numFileBlocks) {
+    fprintf(stderr, "0 <= (blocks=[%d, %d)) <= %d not satisfied.\n", firstBlock, firstBlock + numBlocks, numFileBlocks);
+    return -1;
+  }
+
+  if ((inp->i_mode & ILARG) == 0) {
+    if (firstBlock + numBlocks > N_BLOCKS) return -1;
+    memcpy(blockNums, inp->i_addr + firstBlock, numBlocks * sizeof(uint16_t));
+    return 0;
+  }
+
+  struct blockmapcache *cache = fs->blockmaps;
+  if (cache != NULL) {
+    pthread_mutex_lock(&cache->lock);
+    struct blockmap *m = blockmap_find(cache, inumber);
+    if (m != NULL && memcmp(&m->in, inp, sizeof(struct inode)) == 0) {
+      blockmap_unlink(cache, m);
+      blockmap_pushfront(cache, m);
+      memcpy(blockNums, m->blockNums + firstBlock, numBlocks * sizeof(uint16_t));
+      pthread_mutex_unlock(&cache->lock);
+      return 0;
+    }
+    pthread_mutex_unlock(&cache->lock);
+  }
+
+  struct blockmap *m = malloc(sizeof(struct blockmap));
+  uint16_t *map = malloc(numFileBlocks * sizeof(uint16_t));
+  if (m == NULL || map == NULL || inode_getblockmap(fs, inp, map, numFileBlocks) != numFileBlocks) {
+    free(m);
+    free(map);
+    return -1;
+  }
+  memcpy(blockNums, map + firstBlock, numBlocks * sizeof(uint16_t));
+  if (cache == NULL) {
+    free(m);
+    free(map);
+    return 0;
+  }
+  m->inumber = inumber;
+  m->in = *inp;
+  m->numBlocks = numFileBlocks;
+  m->blockNums = map;
+  pthread_mutex_lock(&cache->lock);
+  blockmap_insert(cache, m);
+  pthread_mutex_unlock(&cache->lock);
+  return 0;
+}
+
 int inode_getsize(struct inode *inp) {
   return ((inp->i_size0 << 16) | inp->i_size1); 
 }
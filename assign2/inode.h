@@ -17,6 +17,42 @@ int inode_iget(struct unixfilesystem *fs, int inumber, struct inode *inp);
  */
 int inode_indexlookup(struct unixfilesystem *fs, struct inode *inp, int blockNum);
 
+/**
+ * Resolves the file's whole logical-to-physical block map in one pass over
+ * i_addr and the indirect and doubly indirect blocks, each of which is read
+ * exactly once.  The disk block numbers of the first maxBlocks file blocks
+ * (or all of them, if there are fewer) are written to out.
+ *
+ * Returns the number of blocks in the file, which may exceed maxBlocks, or
+ * -1 on error.
+ */
+int inode_getblockmap(struct unixfilesystem *fs, struct inode *inp, uint16_t *out, int maxBlocks);
+
+/**
+ * Like inode_indexlookup, but for numBlocks consecutive file blocks starting
+ * with firstBlock, whose disk block numbers are written to blockNums.  inp
+ * must be inode inumber.  The block maps of large files come from fs's block
+ * map cache, shared by every thread, keyed on the inumber and filled in by
+ * inode_getblockmap, so reading a large file a piece at a time walks its
+ * indirect blocks only once.  An entry is only used if the inode still reads
+ * the same as when the map was built.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int inode_indexlookuprange(struct unixfilesystem *fs, int inumber, struct inode *inp, int firstBlock,
+                           int numBlocks, uint16_t *blockNums);
+
+/**
+ * Allocates fs->blockmaps, which unixfilesystem_initwithflags does.  Returns
+ * 0 on success, -1 on error.
+ */
+int inode_initcache(struct unixfilesystem *fs);
+
+/**
+ * Frees fs->blockmaps and every map in it.
+ */
+void inode_freecache(struct unixfilesystem *fs);
+
 /**
  * Computes the size in bytes of the file identified by the given inode
  */
@@ -6,37 +6,142 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 
-int pathname_lookup_recursive(struct unixfilesystem *fs, const char *pathname, int dirinumber) {
-  if (strlen(pathname) == 0 || (*pathname) != '/') {
-    fprintf(stderr, "wrong pathname syntax:%s\n", pathname);
-    return -1;
-  } else if (strlen(pathname) == 1) {
-    return dirinumber;
+/**
+ * The path cache maps absolute pathnames to inumbers.  A lookup that misses
+ * resolves the path's parent (which, when walking a tree, usually hits) and
+ * then just the last component, so each lookup costs one directory search
+ * however deep the path.  Once the cache holds PATH_CACHE_ENTRIES paths it's
+ * emptied and starts over.  It assumes the image isn't modified underneath
+ * it.  Everything is guarded by lock, which isn't held across directory
+ * searches.
+ */
+#define PATH_BUCKETS 4096
+#define PATH_CACHE_ENTRIES (1 << 16)
+
+struct pathentry {
+  char *path;
+  size_t length;
+  int inumber;
+  struct pathentry *next;
+};
+
+struct pathcache {
+  pthread_mutex_t lock;
+  struct pathentry *buckets[PATH_BUCKETS];
+  int numEntries;
+};
+
+static unsigned int pathcache_hash(const char *path, size_t length) {
+  unsigned int hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) hash = (hash ^ (unsigned char) path[i]) * 16777619u;
+  return hash % PATH_BUCKETS;
+}
+
+static void pathcache_clear(struct pathcache *cache) {
+  for (int b = 0; b < PATH_BUCKETS; b++) {
+    while (cache->buckets[b] != NULL) {
+      struct pathentry *entry = cache->buckets[b];
+      cache->buckets[b] = entry->next;
+      free(entry->path);
+      free(entry);
+    }
   }
-  char *nextSlash = strchr(pathname + 1, '/');
-  char *dirEntName;
-  if (nextSlash) {
-    size_t dirEntNameLen = nextSlash - pathname;
-    dirEntName = (char *) malloc(dirEntNameLen);
-    assert(dirEntName != NULL);
-    memcpy(dirEntName, pathname + 1, dirEntNameLen);
-    dirEntName[dirEntNameLen - 1] = '\0';
-  } else {
-    dirEntName = pathname + 1;
+  cache->numEntries = 0;
+}
+
+static int pathcache_find(struct pathcache *cache, const char *path, size_t length) {
+  int inumber = -1;
+  pthread_mutex_lock(&cache->lock);
+  for (struct pathentry *entry = cache->buckets[pathcache_hash(path, length)]; entry != NULL; entry = entry->next) {
+    if (entry->length == length && memcmp(entry->path, path, length) == 0) {
+      inumber = entry->inumber;
+      break;
+    }
   }
-  struct direntv6 dirEnt;
-  if (directory_findname(fs, dirEntName, dirinumber, &dirEnt) < 0) {
+  pthread_mutex_unlock(&cache->lock);
+  return inumber;
+}
+
+static void pathcache_insert(struct pathcache *cache, const char *path, size_t length, int inumber) {
+  struct pathentry *entry = malloc(sizeof(struct pathentry));
+  char *copy = malloc(length);
+  if (entry == NULL || copy == NULL) {
+    free(entry);
+    free(copy);
+    return;
+  }
+  memcpy(copy, path, length);
+  entry->path = copy;
+  entry->length = length;
+  entry->inumber = inumber;
+
+  pthread_mutex_lock(&cache->lock);
+  if (cache->numEntries >= PATH_CACHE_ENTRIES) pathcache_clear(cache);
+  struct pathentry **bucket = &cache->buckets[pathcache_hash(path, length)];
+  entry->next = *bucket;
+  *bucket = entry;
+  cache->numEntries++;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+int pathname_initcache(struct unixfilesystem *fs) {
+  struct pathcache *cache = calloc(1, sizeof(struct pathcache));
+  if (cache == NULL) return -1;
+  pthread_mutex_init(&cache->lock, NULL);
+  fs->paths = cache;
+  return 0;
+}
+
+void pathname_freecache(struct unixfilesystem *fs) {
+  struct pathcache *cache = fs->paths;
+  if (cache == NULL) return;
+  pathcache_clear(cache);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+  fs->paths = NULL;
+}
+
+/**
+ * Resolves the first length characters of the absolute pathname, which
+ * begins with a '/'.  A trailing '/' names the same file as the path without
+ * it, as does a path with doubled slashes.
+ */
+static int pathname_lookupprefix(struct unixfilesystem *fs, const char *pathname, size_t length) {
+  if (length <= 1) return ROOT_INUMBER;
+  struct pathcache *cache = fs->paths;
+  if (cache != NULL) {
+    int inumber = pathcache_find(cache, pathname, length);
+    if (inumber != -1) return inumber;
+  }
+
+  size_t lastSlash = length - 1;
+  while (pathname[lastSlash] != '/') lastSlash--;
+  int dirinumber = pathname_lookupprefix(fs, pathname, lastSlash > 0 ? lastSlash : 1);
+  size_t nameLength = length - lastSlash - 1;
+  if (dirinumber < 0 || nameLength == 0) return dirinumber;
+
+  char name[15];
+  if (nameLength > 14) {
+    fprintf(stderr, "file name greater than 14: %.*s\n", (int) nameLength, pathname + lastSlash + 1);
     return -1;
   }
-  if (nextSlash) {
-    free(dirEntName);
-    return pathname_lookup_recursive(fs, nextSlash, dirEnt.d_inumber);
-  } else {
-    return dirEnt.d_inumber;
+  memcpy(name, pathname + lastSlash + 1, nameLength);
+  name[nameLength] = '\0';
+  struct direntv6 dirEnt;
+  if (directory_findname(fs, name, dirinumber, &dirEnt) < 0) {
+    return -1;
   }
+
+  if (cache != NULL) pathcache_insert(cache, pathname, length, dirEnt.d_inumber);
+  return dirEnt.d_inumber;
 }
 
 int pathname_lookup(struct unixfilesystem *fs, const char *pathname) {
-  return pathname_lookup_recursive(fs, pathname, 1);
+  if (strlen(pathname) == 0 || (*pathname) != '/') {
+    fprintf(stderr, "wrong pathname syntax:%s\n", pathname);
+    return -1;
+  }
+  return pathname_lookupprefix(fs, pathname, strlen(pathname));
 }
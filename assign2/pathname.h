@@ -10,4 +10,16 @@
  */
 int pathname_lookup(struct unixfilesystem *fs, const char *pathname);
 
+/**
+ * Allocates fs->paths, the cache of resolved pathnames that pathname_lookup
+ * consults (and fills) before searching any directories, which
+ * unixfilesystem_initwithflags does.  Returns 0 on success, -1 on error.
+ */
+int pathname_initcache(struct unixfilesystem *fs);
+
+/**
+ * Frees fs->paths and every pathname in it.
+ */
+void pathname_freecache(struct unixfilesystem *fs);
+
 #endif // _PATHNAME_H_
@@ -1,7 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 #include "unixfilesystem.h"
 #include "diskimg.h" 
+#include "inode.h"
+#include "directory.h"
+#include "pathname.h"
 
 /**
  * Allocates and initializes a struct unixfilesystem given a filedescriptor to 
@@ -10,6 +14,35 @@
  */
 
 struct unixfilesystem *unixfilesystem_init(int dfd) {
+  return unixfilesystem_initwithflags(dfd, 0);
+}
+
+/**
+ * Reads (or, for a mapped image, finds) the inode table.  Returns 0 on
+ * success, -1 on error.
+ */
+static int unixfilesystem_loadinodes(struct unixfilesystem *fs) {
+  int numSectors = fs->superblock.s_isize;
+  const void *first = diskimg_getsectorptr(fs->dfd, INODE_START_SECTOR);
+  const void *last = diskimg_getsectorptr(fs->dfd, INODE_START_SECTOR + numSectors - 1);
+  if (numSectors > 0 && first != NULL && last != NULL) {
+    fs->inodes = first;
+    return 0;
+  }
+
+  size_t tableSize = (size_t) numSectors * DISKIMG_SECTOR_SIZE;
+  struct inode *inodes = malloc(tableSize > 0 ? tableSize : 1);
+  if (inodes == NULL) return -1;
+  struct iovec iov = { inodes, tableSize };
+  if (diskimg_readv(fs->dfd, INODE_START_SECTOR, &iov, 1) != (int) tableSize) {
+    free(inodes);
+    return -1;
+  }
+  fs->inodes = fs->ownedInodes = inodes;
+  return 0;
+}
+
+struct unixfilesystem *unixfilesystem_initwithflags(int dfd, int flags) {
   // Validate the bootblock.  This will catch the situation where something 
   // other than a descriptor to a valid diskimg is passed in.
   uint16_t bootblock[256];
@@ -35,11 +68,37 @@ struct unixfilesystem *unixfilesystem_init(int dfd) {
   }
 
   fs->dfd = dfd;  
+  fs->inodes = NULL;
+  fs->ownedInodes = NULL;
+  fs->blockmaps = NULL;
+  fs->dentries = NULL;
+  fs->paths = NULL;
   if (diskimg_readsector(dfd, SUPERBLOCK_SECTOR, &fs->superblock) != DISKIMG_SECTOR_SIZE) {
     fprintf(stderr, "Error reading superblock\n");
     free(fs);
     return NULL;
   }
 
+  if ((flags & UNIXFILESYSTEM_INODETABLE) && unixfilesystem_loadinodes(fs) == -1) {
+    fprintf(stderr, "Error reading inode table\n");
+    free(fs);
+    return NULL;
+  }
+
+  if (inode_initcache(fs) == -1 || directory_initcache(fs) == -1 || pathname_initcache(fs) == -1) {
+    fprintf(stderr,"Out of memory.\n");
+    unixfilesystem_free(fs);
+    return NULL;
+  }
+
   return fs;
 }
+
+void unixfilesystem_free(struct unixfilesystem *fs) {
+  if (fs == NULL) return;
+  inode_freecache(fs);
+  directory_freecache(fs);
+  pathname_freecache(fs);
+  free(fs->ownedInodes);
+  free(fs);
+}
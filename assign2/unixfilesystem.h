@@ -25,11 +25,35 @@
 #define ROOT_INUMBER        1
 #define BOOTBLOCK_MAGIC_NUM 0407
 
+// Flags for unixfilesystem_initwithflags.
+#define UNIXFILESYSTEM_INODETABLE 1  // read the whole inode table into memory up front
+
 struct unixfilesystem {
   int dfd; // Handle from the diskimg module to read the diskimg.
   struct filsys superblock;  // The superblock read from the diskimage.
+  const struct inode *inodes;  // The inode table (inode n at n - 1), or NULL if it wasn't loaded.
+  struct inode *ownedInodes;   // inodes again if it was allocated, or NULL if it points into a mapped image.
+  struct blockmapcache *blockmaps;  // Block maps of recently read large files (see inode.c).
+  struct dentrycache *dentries;  // Indexes of recently searched directories (see directory.c).
+  struct pathcache *paths;       // Recently resolved pathnames (see pathname.c).
 };
 
 struct unixfilesystem *unixfilesystem_init(int fd);
 
+/**
+ * Like unixfilesystem_init, but flags can ask for UNIXFILESYSTEM_INODETABLE,
+ * in which case all s_isize sectors of inodes are read with a single read
+ * (or, if the image is mapped, used in place), and inode_iget copies inodes
+ * out of memory from then on.  The table isn't updated by later writes, so
+ * it's meant for read-only use.
+ */
+struct unixfilesystem *unixfilesystem_initwithflags(int fd, int flags);
+
+/**
+ * Frees a struct unixfilesystem returned by either init function, along
+ * with its inode table and its block map, directory and pathname caches.
+ * The disk image is left open.
+ */
+void unixfilesystem_free(struct unixfilesystem *fs);
+
 #endif // _UNIXFILESYSTEM_H_